@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cassert>
 #include <stdexcept>
 
@@ -64,7 +65,7 @@ void DigitalClock::Digit::render(SDL_Surface* fb) {
 }
 
 DigitalClock::DigitalClock(int w, int h, bool hue_cycle) :
-	hue_cycle_(hue_cycle), last_minute_(-1), last_second_(-1),
+	hue_cycle_(hue_cycle), hue_(0.0), last_minute_(-1), last_second_(-1),
 	fb(nullptr, SDL_FreeSurface) {
 	fb.reset(make_surface(w, h));
 
@@ -72,7 +73,8 @@ DigitalClock::DigitalClock(int w, int h, bool hue_cycle) :
 	// gap, 2*digit, gap, 2*digit, colon, 2*digit, gap 2*digit, gap = 13
 	// For height, it's 2*gap, 3*digit, 2*gap = 7
 	SDL_FillRect(fb.get(), nullptr, 0);
-	const int st = 8;
+	// Segment thickness; thinner if we're being run at a chunky pixel scale.
+	const int st = std::max(2, std::min(8, w / 60));
 	int y = ((2*h) / 7) - (st/2); // centering correction
 	int sw = (2*w) / 13;
 	int sh = (3*h) / 14; // i.e. 1.5 sevenths
@@ -174,7 +176,8 @@ bool DigitalClock::set_time(const std::tm* tm) {
 	s = std::min(tm->tm_sec, 59); // no doing evil with leap seconds
 	if (hue_cycle_) {
 		s += 60 * (tm->tm_min % k_hue_rotation_minutes);
-		hue_to_rgb(s/(60.0 * k_hue_rotation_minutes), r, g, b);
+		hue_ = s/(60.0 * k_hue_rotation_minutes);
+		hue_to_rgb(hue_, r, g, b);
 	} else {
 		b = 0;
 		if(tm->tm_min % 2) { s = 59 - s; }
@@ -217,6 +220,14 @@ bool DigitalClock::solid_at(int x, int y) {
 		[(x*bytes_per_pixel_)+(y*pitch_)] != 0;
 }
 
+const Uint8* DigitalClock::solid_row(int y) {
+	auto buffer = fb.get();
+	// make_surface() asks for 8 bits, so this should always hold.
+	assert(bytes_per_pixel_ == 1);
+	assert(y >= 0); assert(y < buffer->h);
+	return static_cast<const Uint8 *>(buffer->pixels) + (y*pitch_);
+}
+
 DigitalClock::Digit& DigitalClock::get_digit(int i) {
 	assert(i >= 0); assert (i <= 4);
 	return digits[i];
@@ -20,6 +20,7 @@ class DigitalClock {
 	Digit digits[4];
 
 	bool hue_cycle_;
+	double hue_;
 	int last_minute_;
 	int last_second_;
 	std::unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)> fb;
@@ -42,10 +43,16 @@ public:
 	// This is better but ultimately I preferred leaving the hue alone.
 	double big_dirty_sin(double x);
 	void hue_to_rgb(double h, Uint8& out_r, Uint8& out_g, Uint8& out_b);
+	// Hue, in [0,1), that the clock is currently colored with by
+	// hue_to_rgb(). Only meaningful if hue cycling.
+	double hue() const { return hue_; }
 	// Returns true if solid regions have changed.
 	bool set_time(const std::tm* tm);
 	SDL_Surface* rendered(); // treat as const
 	bool solid_at(int x, int y);
+	// Row y of the solid mask, one byte per column, nonzero meaning solid.
+	// For sweeping a whole row at once rather than a solid_at() per cell.
+	const Uint8* solid_row(int y);
 	Digit& get_digit(int i); // treat as const
 };
 
@@ -0,0 +1,308 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <linux/fb.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#include <arm_neon.h>
+	#define FRAMEBUFFER_NEON 1
+#endif
+
+#include "framebuffer.hpp"
+
+// What a regular file stands in for: the Tontec, 480x320 RGB565.
+constexpr int k_stand_in_w = 480;
+constexpr int k_stand_in_h = 320;
+
+// 4x4 Bayer matrix, thresholds 0-15.
+const int k_bayer[4][4] = {
+	{ 0,  8,  2, 10},
+	{12,  4, 14,  6},
+	{ 3, 11,  1,  9},
+	{15,  7, 13,  5},
+};
+
+namespace {
+	std::runtime_error error(const std::string& what,
+		const std::string& path) {
+		return std::runtime_error(what + " '" + path + "': "
+			+ std::strerror(errno));
+	}
+
+	// The common case: ARGB8888 in, RGB565 out. bias is the dither for x mod
+	// 4, per channel. Adding it saturates at 255, which is what the LUTs of
+	// the general case get too, so they all agree exactly.
+	inline Uint16 rgb565_at(Uint32 pixel, const Uint8* bias) {
+		const Uint32 r = std::min(255u, ((pixel >> 16) & 0xff) + bias[0]);
+		const Uint32 g = std::min(255u, ((pixel >> 8) & 0xff) + bias[1]);
+		const Uint32 b = std::min(255u, (pixel & 0xff) + bias[2]);
+		return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+	}
+
+	void rgb565_scalar(Uint16* to, const Uint32* from, int w,
+		const Uint8 (*bias)[3]) {
+		for(int x = 0; x < w; ++x) { to[x] = rgb565_at(from[x], bias[x & 3]); }
+	}
+
+#if defined(__SSE2__)
+	// Four pixels a vector, which is exactly one period of the dither.
+	void rgb565_sse2(Uint16* to, const Uint32* from, int w,
+		const Uint8 (*bias)[3]) {
+		// Bytes in memory are B, G, R, A.
+		const __m128i dither = _mm_setr_epi8(
+			bias[0][2], bias[0][1], bias[0][0], 0,
+			bias[1][2], bias[1][1], bias[1][0], 0,
+			bias[2][2], bias[2][1], bias[2][0], 0,
+			bias[3][2], bias[3][1], bias[3][0], 0);
+		const __m128i red = _mm_set1_epi32(0xf800);
+		const __m128i green = _mm_set1_epi32(0x07e0);
+		const __m128i blue = _mm_set1_epi32(0x001f);
+		const __m128i half = _mm_set1_epi32(0x8000);
+		auto convert = [&](const Uint32* p) {
+			__m128i v = _mm_adds_epu8(_mm_loadu_si128(
+				reinterpret_cast<const __m128i*>(p)), dither);
+			__m128i out = _mm_or_si128(
+				_mm_and_si128(_mm_srli_epi32(v, 8), red),
+				_mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 5), green),
+					_mm_and_si128(_mm_srli_epi32(v, 3), blue)));
+			// Offset into signed range, for the saturating pack.
+			return _mm_sub_epi32(out, half);
+		};
+		int x = 0;
+		for(; x + 8 <= w; x += 8) {
+			__m128i packed = _mm_packs_epi32(convert(from + x),
+				convert(from + x + 4));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(to + x),
+				_mm_xor_si128(packed, _mm_set1_epi16(-0x8000)));
+		}
+		for(; x < w; ++x) { to[x] = rgb565_at(from[x], bias[x & 3]); }
+	}
+#endif
+
+#if defined(FRAMEBUFFER_NEON)
+	// Eight pixels a vector, split into channels by the load.
+	void rgb565_neon(Uint16* to, const Uint32* from, int w,
+		const Uint8 (*bias)[3]) {
+		uint8x8_t dither[3];
+		for(int c = 0; c < 3; ++c) {
+			const Uint8 lanes[8] = {bias[0][c], bias[1][c], bias[2][c],
+				bias[3][c], bias[0][c], bias[1][c], bias[2][c], bias[3][c]};
+			dither[c] = vld1_u8(lanes);
+		}
+		int x = 0;
+		for(; x + 8 <= w; x += 8) {
+			// val[0] to [3] are B, G, R, A.
+			uint8x8x4_t v = vld4_u8(reinterpret_cast<const Uint8*>(from + x));
+			uint16x8_t out = vshll_n_u8(vqadd_u8(v.val[2], dither[0]), 8);
+			out = vsriq_n_u16(out,
+				vshll_n_u8(vqadd_u8(v.val[1], dither[1]), 8), 5);
+			out = vsriq_n_u16(out,
+				vshll_n_u8(vqadd_u8(v.val[0], dither[2]), 8), 11);
+			vst1q_u16(to + x, out);
+		}
+		for(; x < w; ++x) { to[x] = rgb565_at(from[x], bias[x & 3]); }
+	}
+#endif
+
+	Framebuffer::RGB565Line best_rgb565() {
+#if defined(__SSE2__)
+		if(SDL_HasSSE2()) { return rgb565_sse2; }
+#endif
+#if defined(FRAMEBUFFER_NEON)
+	#if SDLVERSION == 1
+		return rgb565_neon;
+	#else
+		if(SDL_HasNEON()) { return rgb565_neon; }
+	#endif
+#endif
+		return rgb565_scalar;
+	}
+};
+
+Framebuffer::Framebuffer(const std::string& path) :
+	fd_(-1), map_(nullptr), map_size_(0), frames_(0), bytes_(0) {
+
+	fd_ = open(path.c_str(), O_RDWR);
+	if(fd_ < 0) { throw error("Can't open", path); }
+
+	size_t offset = 0;
+	fb_var_screeninfo var;
+	fb_fix_screeninfo fix;
+	if(ioctl(fd_, FBIOGET_VSCREENINFO, &var) == 0
+		&& ioctl(fd_, FBIOGET_FSCREENINFO, &fix) == 0) {
+		w_ = var.xres;
+		h_ = var.yres;
+		bytes_per_pixel_ = var.bits_per_pixel / 8;
+		pitch_ = fix.line_length;
+		red_ = {static_cast<int>(var.red.offset),
+			static_cast<int>(var.red.length)};
+		green_ = {static_cast<int>(var.green.offset),
+			static_cast<int>(var.green.length)};
+		blue_ = {static_cast<int>(var.blue.offset),
+			static_cast<int>(var.blue.length)};
+		map_size_ = fix.smem_len;
+		// Where it's panned to, if it's double-buffered.
+		offset = (var.yoffset * pitch_) + (var.xoffset * bytes_per_pixel_);
+	} else {
+		w_ = k_stand_in_w;
+		h_ = k_stand_in_h;
+		bytes_per_pixel_ = 2;
+		pitch_ = w_ * bytes_per_pixel_;
+		red_ = {11, 5};
+		green_ = {5, 6};
+		blue_ = {0, 5};
+		map_size_ = pitch_ * h_;
+		struct stat st;
+		if(fstat(fd_, &st) != 0 || static_cast<size_t>(st.st_size)
+			< map_size_) {
+			close(fd_);
+			errno = EINVAL;
+			throw error("Not a framebuffer, nor a big enough file to stand in"
+				" for one", path);
+		}
+	}
+	if(bytes_per_pixel_ != 2 && bytes_per_pixel_ != 4) {
+		close(fd_);
+		throw std::runtime_error("Can't write "
+			+ std::to_string(bytes_per_pixel_ * 8) + "-bit pixels to '"
+			+ path + "'");
+	}
+
+	void* map = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+		fd_, 0);
+	if(map == MAP_FAILED) {
+		close(fd_);
+		throw error("Can't map", path);
+	}
+	map_ = static_cast<Uint8*>(map);
+	pixels_ = map_ + offset;
+	line_.resize(w_ * bytes_per_pixel_);
+
+	// Dithering spreads the rounding to fewer bits over neighbouring pixels:
+	// adding up to a step's worth, by position, before truncating keeps the
+	// average right, rather than banding.
+	const Channel* channels[3] = {&red_, &green_, &blue_};
+	for(int c = 0; c < 3; ++c) {
+		const int length = std::min(8, channels[c]->length);
+		for(int v = 0; v < 256; ++v) {
+			lut_[c][v] = static_cast<Uint32>(v >> (8 - length))
+				<< channels[c]->offset;
+		}
+		const int step = 1 << (8 - length);
+		for(int y = 0; y < 4; ++y) {
+			for(int x = 0; x < 4; ++x) {
+				bias_[y][x][c] = (k_bayer[y][x] * step) / 16;
+			}
+		}
+	}
+	rgb565_ = (bytes_per_pixel_ == 2 && red_.offset == 11
+		&& red_.length == 5 && green_.offset == 5 && green_.length == 6
+		&& blue_.offset == 0 && blue_.length == 5) ? best_rgb565() : nullptr;
+	// Start from what's there, so nothing's rewritten that needn't be.
+	shadow_.resize(line_.size() * h_);
+	for(int y = 0; y < h_; ++y) {
+		std::memcpy(&shadow_[y * line_.size()], pixels_ + (y * pitch_),
+			line_.size());
+	}
+}
+
+Framebuffer::~Framebuffer() {
+	munmap(map_, map_size_);
+	close(fd_);
+}
+
+// Scaled up by repeating pixels; any columns or rows left over at the far
+// edges (if the size doesn't divide by scale) repeat the last ones.
+void Framebuffer::convert_line(const SDL_Surface* frame, int y, int scale) {
+	const SDL_PixelFormat* format = frame->format;
+	const Uint32* from = reinterpret_cast<const Uint32*>(
+		static_cast<const Uint8*>(frame->pixels)
+		+ (std::min(y / scale, frame->h - 1) * frame->pitch));
+	const Uint8 (*bias)[3] = bias_[y & 3];
+	if(rgb565_ && scale == 1 && frame->w >= w_ && format->Rshift == 16
+		&& format->Gshift == 8 && format->Bshift == 0) {
+		rgb565_(reinterpret_cast<Uint16*>(line_.data()), from, w_, bias);
+		return;
+	}
+	Uint16* to16 = reinterpret_cast<Uint16*>(line_.data());
+	Uint32* to32 = reinterpret_cast<Uint32*>(line_.data());
+	for(int x = 0; x < w_; ++x) {
+		const Uint32 pixel = from[std::min(x / scale, frame->w - 1)];
+		const Uint8* b = bias[x & 3];
+		const Uint32 out =
+			lut_[0][std::min(255u, ((pixel & format->Rmask) >> format->Rshift)
+				+ b[0])]
+			| lut_[1][std::min(255u, ((pixel & format->Gmask) >> format->Gshift)
+				+ b[1])]
+			| lut_[2][std::min(255u, ((pixel & format->Bmask) >> format->Bshift)
+				+ b[2])];
+		if(bytes_per_pixel_ == 2) {
+			to16[x] = out;
+		} else {
+			to32[x] = out;
+		}
+	}
+}
+
+// Compared a word at a time, from each end, to find the changed span. Words
+// are whole pixels at 16 and 32 bits, so the span is too.
+size_t Framebuffer::write_line(int y) {
+	typedef std::uint64_t Word;
+	const size_t line_bytes = line_.size();
+	const size_t words = line_bytes / sizeof(Word);
+	const Uint8* line = line_.data();
+	Uint8* shadow = &shadow_[y * line_bytes];
+	auto same = [&](size_t i) {
+		Word a, b;
+		std::memcpy(&a, line + (i * sizeof(Word)), sizeof(Word));
+		std::memcpy(&b, shadow + (i * sizeof(Word)), sizeof(Word));
+		return a == b;
+	};
+	size_t begin = 0;
+	while(begin < words && same(begin)) { ++begin; }
+	begin *= sizeof(Word);
+	// Any odd bytes at the end are compared as a whole.
+	size_t end = line_bytes;
+	if(std::memcmp(line + (words * sizeof(Word)),
+		shadow + (words * sizeof(Word)), line_bytes % sizeof(Word)) == 0) {
+		size_t word_end = words;
+		while(word_end * sizeof(Word) > begin && same(word_end - 1)) {
+			--word_end;
+		}
+		end = word_end * sizeof(Word);
+	}
+	if(end <= begin) { return 0; }
+	std::memcpy(pixels_ + (y * pitch_) + begin, line + begin, end - begin);
+	std::memcpy(shadow + begin, line + begin, end - begin);
+	return end - begin;
+}
+
+size_t Framebuffer::present(const SDL_Surface* frame, int scale) {
+	size_t written = 0;
+	for(int y = 0; y < h_; ++y) {
+		// Each line, even scaled-up repeats, as the dither differs.
+		convert_line(frame, y, scale);
+		written += write_line(y);
+	}
+	++frames_;
+	bytes_ += written;
+	return written;
+}
+
+void Framebuffer::report(std::ostream& out) const {
+	const std::uint64_t whole = shadow_.size();
+	out << "Framebuffer: " << frames_ << " frames, "
+		<< (frames_ ? bytes_ / frames_ : 0) << " bytes written per frame of "
+		<< whole << " (" << (frames_ ? (100 * bytes_) / (frames_ * whole) : 0)
+		<< "%)" << std::endl;
+}
@@ -0,0 +1,79 @@
+#ifndef FRAMEBUFFER_HPP_
+#define FRAMEBUFFER_HPP_
+
+/* Direct output to a Linux framebuffer device (/dev/fbN), memory-mapped, so
+ * the SDL 2 build can drive small SPI panels like the Tontec without a window
+ * system or a GPU in between. Frames are converted to the panel's pixel
+ * format a line at a time, and compared with a shadow copy of what was last
+ * written (in ordinary memory, as reading the device's may be slow), and only
+ * the span of each line that changed is written: on fbtft-style panels, where
+ * the bus is the bottleneck, the driver only sends the pages touched.
+ *
+ * Conversion to fewer than 8 bits a channel is ordered-dithered, so smooth
+ * ramps (the snow's greys, the clock's hues) don't band. RGB565, by far the
+ * usual on small panels, has SSE2 and NEON versions; anything else goes
+ * through lookup tables a channel at a time.
+ *
+ * A regular file works in place of the device, standing in for a Tontec-like
+ * panel (so it needs to be at least that big), e.g. for trying it out on a
+ * machine without one.
+ */
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "hack.hpp"
+
+class Framebuffer {
+public:
+	// A line of ARGB8888 to RGB565; bias is the dither for x mod 4.
+	typedef void (*RGB565Line)(Uint16* to, const Uint32* from, int w,
+		const Uint8 (*bias)[3]);
+
+private:
+	struct Channel {
+		int offset;
+		int length;
+	};
+
+	int fd_;
+	Uint8* map_;
+	size_t map_size_;
+	Uint8* pixels_; // The visible part of the mapping.
+	int w_, h_;
+	int bytes_per_pixel_;
+	int pitch_;
+	Channel red_, green_, blue_;
+	Uint32 lut_[3][256]; // R, G, B value to its bits of a pixel.
+	Uint8 bias_[4][4][3]; // Dither to add by y and x mod 4, and channel.
+	RGB565Line rgb565_; // If the display is plain RGB565.
+	std::vector<Uint8> line_; // One line converted, to compare and copy.
+	std::vector<Uint8> shadow_; // What's on the device, packed.
+	std::uint64_t frames_;
+	std::uint64_t bytes_;
+
+	void convert_line(const SDL_Surface* frame, int y, int scale);
+	size_t write_line(int y);
+
+public:
+	// Throws std::runtime_error if it can't be opened and mapped, or is in a
+	// pixel format we can't write (we do 16 and 32 bits per pixel).
+	explicit Framebuffer(const std::string& path);
+	~Framebuffer();
+	Framebuffer(const Framebuffer&) = delete;
+	Framebuffer& operator=(const Framebuffer&) = delete;
+
+	int w() const { return w_; }
+	int h() const { return h_; }
+
+	// Write out a 32-bit frame of the display's size divided by scale, which
+	// it's scaled back up by. Returns how many bytes were written.
+	size_t present(const SDL_Surface* frame, int scale);
+
+	// Bytes written per frame so far, against writing every frame whole.
+	void report(std::ostream& out) const;
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "framedump.hpp"
+
+// Frames allowed to be waiting to be written.
+constexpr size_t k_queue_frames = 8;
+
+FrameDump::FrameDump(const std::string& path, int w, int h,
+	const SDL_PixelFormat* format, int tick_ms) :
+	path_(path), w_(w), h_(h), format_(format), stream_(nullptr),
+	written_(0), quit_(false) {
+
+	if(format->BitsPerPixel != 32) {
+		throw std::runtime_error("Can only dump 32-bit frames");
+	}
+	const std::string suffix = ".y4m";
+	y4m_ = path.size() >= suffix.size() && path.compare(
+		path.size() - suffix.size(), suffix.size(), suffix) == 0;
+	if(y4m_) {
+		stream_ = std::fopen(path.c_str(), "wb");
+		if(stream_ == nullptr) {
+			throw std::runtime_error("Can't write '" + path + "'");
+		}
+		// Rec. 601, limited range, which is what readers assume without
+		// being told otherwise.
+		std::fprintf(stream_, "YUV4MPEG2 W%d H%d F1000:%d Ip A1:1 C444\n",
+			w, h, tick_ms);
+	}
+	thread_ = std::thread(&FrameDump::run, this);
+}
+
+FrameDump::~FrameDump() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		quit_ = true;
+	}
+	wake_.notify_one();
+	thread_.join(); // Finishes off the queue first.
+	if(stream_) { std::fclose(stream_); }
+	std::cerr << "Dumped " << written_ << " frames to '" << path_ << "'"
+		<< std::endl;
+}
+
+void FrameDump::push(const SDL_Surface* fb) {
+	Frame frame;
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if(!spare_.empty()) {
+			frame.swap(spare_.back());
+			spare_.pop_back();
+		}
+	}
+	const size_t row_bytes = w_ * 4;
+	frame.resize(row_bytes * h_);
+	const Uint8* from = static_cast<const Uint8*>(fb->pixels);
+	for(int y = 0; y < h_; ++y) {
+		std::memcpy(&frame[y * row_bytes], from + (y * fb->pitch), row_bytes);
+	}
+	enqueue(std::move(frame));
+}
+
+// An empty frame in the queue means the same again.
+void FrameDump::repeat() { enqueue(Frame()); }
+
+void FrameDump::enqueue(Frame frame) {
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		space_.wait(lock, [&]{ return queue_.size() < k_queue_frames; });
+		queue_.push_back(std::move(frame));
+	}
+	wake_.notify_one();
+}
+
+void FrameDump::run() {
+	Frame previous;
+	std::unique_lock<std::mutex> lock(mutex_);
+	while(true) {
+		wake_.wait(lock, [&]{ return !queue_.empty() || quit_; });
+		if(queue_.empty()) { return; } // Quitting, and all written.
+		Frame frame;
+		frame.swap(queue_.front());
+		queue_.pop_front();
+		space_.notify_one();
+		lock.unlock();
+		if(!frame.empty()) { previous.swap(frame); }
+		// Repeating before anything's been drawn still takes up a tick.
+		if(previous.empty()) { previous.assign(w_ * h_ * 4, 0); }
+		write(previous);
+		lock.lock();
+		if(!frame.empty()) { spare_.push_back(std::move(frame)); }
+	}
+}
+
+void FrameDump::write(const Frame& frame) {
+	if(y4m_) { write_y4m(frame); } else { write_bmp(frame); }
+	++written_;
+}
+
+void FrameDump::write_y4m(const Frame& frame) {
+	const size_t pixels = w_ * h_;
+	std::vector<Uint8> planes(pixels * 3);
+	Uint8* ys = &planes[0];
+	Uint8* us = ys + pixels;
+	Uint8* vs = us + pixels;
+	const Uint32* from = reinterpret_cast<const Uint32*>(frame.data());
+	for(size_t i = 0; i < pixels; ++i) {
+		const int r = (from[i] & format_->Rmask) >> format_->Rshift;
+		const int g = (from[i] & format_->Gmask) >> format_->Gshift;
+		const int b = (from[i] & format_->Bmask) >> format_->Bshift;
+		ys[i] = (((66 * r) + (129 * g) + (25 * b) + 128) >> 8) + 16;
+		us[i] = (((-38 * r) - (74 * g) + (112 * b) + 128) >> 8) + 128;
+		vs[i] = (((112 * r) - (94 * g) - (18 * b) + 128) >> 8) + 128;
+	}
+	std::fputs("FRAME\n", stream_);
+	std::fwrite(planes.data(), 1, planes.size(), stream_);
+}
+
+void FrameDump::write_bmp(const Frame& frame) {
+	char number[16];
+	std::snprintf(number, sizeof(number), "%06d.bmp", written_);
+	const std::string path = path_ + number;
+	SDL_Surface* surface = SDL_CreateRGBSurfaceFrom(
+		const_cast<Uint8*>(frame.data()), w_, h_, 32, w_ * 4,
+		format_->Rmask, format_->Gmask, format_->Bmask, 0);
+	if(surface == nullptr || SDL_SaveBMP(surface, path.c_str()) != 0) {
+		std::cerr << "Can't write '" << path << "': " << SDL_GetError()
+			<< std::endl;
+	}
+	SDL_FreeSurface(surface);
+}
@@ -0,0 +1,65 @@
+#ifndef FRAMEDUMP_HPP_
+#define FRAMEDUMP_HPP_
+
+/* Writes frames out, for comparing runs offline: e.g. that an optimized
+ * kernel still draws exactly what the old one did, or to watch a run back.
+ * A path ending ".y4m" gets a YUV4MPEG2 stream (4:4:4, so no chroma is lost);
+ * anything else is a prefix for numbered BMPs, e.g. "out/snow-" gives
+ * out/snow-000000.bmp and on.
+ *
+ * Frames are copied as they're pushed, and converted and written on a
+ * background thread, so only the copy costs the caller. The queue between is
+ * bounded; if the disk can't keep up, pushing waits.
+ */
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hack.hpp"
+
+class FrameDump {
+	typedef std::vector<Uint8> Frame;
+
+	std::string path_;
+	bool y4m_;
+	int w_, h_;
+	const SDL_PixelFormat* format_;
+	std::FILE* stream_; // For y4m.
+	int written_;
+
+	std::mutex mutex_;
+	std::condition_variable wake_; // Writer: frames queued, or quitting.
+	std::condition_variable space_; // Pusher: room in the queue.
+	std::deque<Frame> queue_;
+	std::vector<Frame> spare_; // Written frames, to reuse the memory of.
+	bool quit_;
+	std::thread thread_;
+
+	void write(const Frame& frame);
+	void write_y4m(const Frame& frame);
+	void write_bmp(const Frame& frame);
+	void enqueue(Frame frame);
+	void run();
+
+public:
+	// Frames must all be w by h and in format, which must be 32-bit and
+	// outlive this. tick_ms is the frame time, for the y4m header.
+	FrameDump(const std::string& path, int w, int h,
+		const SDL_PixelFormat* format, int tick_ms);
+	// Waits for everything queued to be written.
+	~FrameDump();
+	FrameDump(const FrameDump&) = delete;
+	FrameDump& operator=(const FrameDump&) = delete;
+
+	void push(const SDL_Surface* fb);
+	// Write the last frame again, for a tick the hack didn't redraw (or a
+	// black one, if there hasn't been one yet).
+	void repeat();
+};
+
+#endif
@@ -6,7 +6,11 @@
  * do a pretty thing.
  */
 
+#include <functional>
+#include <map>
 #include <memory>
+#include <string>
+#include <vector>
 
 // This is a bit wrong, given sdl-config output, but, makes VSCode happy? :/
 #ifndef SDLVERSION
@@ -34,18 +38,91 @@ namespace Hack {
 		SCREEN_OFF, WAKE, QUIT, SHUTDOWN
 	};
 
+	// A named number a hack publishes about its workings, for the overlay.
+	struct Counter {
+		const char* name;
+		long value;
+	};
+	typedef std::vector<Counter> Counters;
+
 	struct Base {
 		virtual ~Base() {}
 		virtual void simulate() = 0;
 		// Return true if render() should be called, else is skipped.
 		inline virtual bool want_render() { return true; }
 		virtual void render(SDL_Surface* fb) = 0;
+		/* Hacks that keep where things were on the previous tick, as well as
+		 * where they are now, can draw them in between, so motion glides
+		 * rather than steps. It's only cosmetic: things still move a tick's
+		 * worth per tick, so the tick duration sets their speed as ever, and
+		 * slower ticks don't save anything without moving slower too. If this
+		 * is true, the main loop also renders between ticks, as often as a
+		 * display would show, through render_between(). alpha is how far
+		 * through the current tick we are, from 0 (as of the previous tick)
+		 * to 1 (the latest). */
+		inline virtual bool interpolates() { return false; }
+		inline virtual void render_between(SDL_Surface* fb, double alpha)
+			{ render(fb); }
 		virtual Uint32 tick_duration() = 0;
+		/* Catch up on ticks missed while frozen (under the menu, or with the
+		 * screen off), flat out: nothing is rendered, and anything done each
+		 * tick only for the sake of drawing can be skipped. Before each tick,
+		 * call step(), which sets the wall clock to when it would have run;
+		 * stop early if it returns false. May be called on a worker thread,
+		 * with nothing else touching the hack until it returns. Returns how
+		 * many ticks were run. */
+		inline virtual Uint32 fast_forward(Uint32 ticks,
+			const std::function<bool()>& step) {
+			Uint32 run = 0;
+			for(; run < ticks && step(); ++run) { simulate(); }
+			return run;
+		}
+		// Milliseconds from now for which simulate() would change nothing
+		// visible, so the main loop may block on events instead of ticking.
+		// Zero means keep ticking as normal.
+		inline virtual Uint32 idle_duration() { return 0; }
+		// About to be shown again after something else (the menu) drew over
+		// the screen, or after being suspended for a while.
+		inline virtual void resume() {}
+		// Rough size of what the hack has allocated, for cache budgeting.
+		inline virtual size_t memory_footprint() { return 0; }
+		// Append anything worth watching when diagnosing it on the device.
+		inline virtual void counters(Counters& out) {}
 
 		// For the menu only, process an event.
 		inline virtual MenuResult event(SDL_Event* event)
 			{ return MenuResult::RETURN_TO_HACK; }
 		inline virtual std::string next_hack() { return ""; } // also menu only
+		// Also menu only; back to the top page, ready to be shown again.
+		inline virtual void open_menu() {}
+	};
+
+	/* Tunables a hack declares, so they can be set per-deployment from the
+	 * config (or swept by a benchmark) rather than being compile-time only. */
+	struct Param {
+		enum class Type { INT, FLOAT, BOOL };
+		const char* name;
+		Type type;
+		double default_value;
+		// Config values outside these are clamped to them (with a warning).
+		double min_value;
+		double max_value;
+	};
+	typedef std::vector<Param> ParamSchema;
+
+	// Values for a hack's params; anything not set takes its default.
+	class Params {
+		std::map<std::string, double> values_;
+	public:
+		void set(const std::string& name, double value)
+			{ values_[name] = value; }
+		double get(const Param& param) const {
+			auto it = values_.find(param.name);
+			return it == values_.end() ? param.default_value : it->second;
+		}
+		long get_int(const Param& param) const
+			{ return static_cast<long>(get(param)); }
+		bool get_bool(const Param& param) const { return get(param) != 0.0; }
 	};
 
 	/* Just dumping some factory functions here. You could make this all
@@ -60,11 +137,21 @@ namespace Hack {
 #if SDLVERSION != 1
 	std::unique_ptr<Hack::Base> MakeMenu(int w, int h, void* config);
 #endif
-	std::unique_ptr<Hack::Base> MakeSnowFP(int w, int h, SDL_PixelFormat* fmt);
-	std::unique_ptr<Hack::Base> MakeSnowInt(int w, int h, SDL_PixelFormat* fmt);
-	std::unique_ptr<Hack::Base> MakeSnowClock(int w, int h);
-	std::unique_ptr<Hack::Base> MakePopClock(int w, int h);
+	std::unique_ptr<Hack::Base> MakeSnowFP(int w, int h, SDL_PixelFormat* fmt,
+		const Params& params = Params());
+	std::unique_ptr<Hack::Base> MakeSnowInt(int w, int h, SDL_PixelFormat* fmt,
+		const Params& params = Params());
+	std::unique_ptr<Hack::Base> MakeSnowClock(int w, int h,
+		const Params& params = Params());
+	std::unique_ptr<Hack::Base> MakePopClock(int w, int h,
+		const Params& params = Params());
 	std::unique_ptr<Hack::Base> MakeColorCycle();
+
+	// And the params each of those understands.
+	const ParamSchema& SnowFPParams();
+	const ParamSchema& SnowIntParams();
+	const ParamSchema& SnowClockParams();
+	const ParamSchema& PopClockParams();
 };
 
 #endif
@@ -0,0 +1,60 @@
+#ifndef MARGOLUS_HPP_
+#define MARGOLUS_HPP_
+
+/* Block-cellular engine for the falling-sand layers (settled snow, settled
+ * clock particles). Each pass carves the grid into 2x2 blocks (a Margolus
+ * neighbourhood) and a rule updates each block using, and writing to, only its
+ * own four cells. Blocks are therefore independent of each other, so a pass
+ * gives the same answer whatever order they're done in: no sweep-direction
+ * bias in which way things spill, and free to vectorize or split across
+ * threads. The block grid shifts by one cell each pass (alternating (0,0) and
+ * (1,1) offsets) so that things can cross block boundaries.
+ *
+ * Since all that falls goes downwards, the rule is handed a pair of rows at a
+ * time, which is the shape that vectorizes:
+ *     rule(Cell* top, Cell* bottom, int y, int offset)
+ * top is row y, bottom row y+1, or nullptr when the pair hangs off the bottom
+ * of the grid (so the rule can decide whether things fall out). Within the
+ * pair, columns x and partner(x, offset) share a block.
+ */
+
+template<typename Cell>
+class Margolus {
+	int w_, h_;
+	unsigned int pass_;
+
+public:
+	Margolus(int w, int h) : w_(w), h_(h), pass_(0) {}
+
+	// Block grid offset for the pass about to run, 0 or 1.
+	int offset() const { return pass_ & 1; }
+
+	// The other column in x's block, or -1 if that's off the grid.
+	int partner(int x, int offset) const {
+		int p = ((x - offset) & 1) ? x - 1 : x + 1;
+		return (p >= 0 && p < w_) ? p : -1;
+	}
+
+	/* Run one pass of rule over w*h cells, skipping rows above y_min.
+	 * Row y_min itself is always in a pair that's run; it may be the bottom
+	 * of it, in which case it only gets to be a top next pass. So anything
+	 * wanting a row looked at needs to ask for two passes. */
+	template<typename Rule>
+	void pass(Cell* cells, int y_min, Rule&& rule) {
+		const int offset = this->offset();
+		// Align to the top of a pair; the pair above row 0 is empty.
+		int y = y_min - ((y_min - offset) & 1);
+		if(y < 0) { y += 2; }
+		for(; y < h_; y += 2) {
+			Cell* top = cells + (y*w_);
+			rule(top, (y+1 < h_) ? top + w_ : nullptr, y, offset);
+		}
+		++pass_;
+	}
+
+	// For when there's nothing to do this pass, but the offsets should still
+	// alternate as if there had been.
+	void skip() { ++pass_; }
+};
+
+#endif
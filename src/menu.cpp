@@ -28,9 +28,19 @@ struct Menu : public Hack::Base {
 
 	enum class Page { TOP, CHOOSE_HACK, SLEEP, SHUTDOWN, POWEROFF };
 	Page page;
+	bool needs_paint; // Page or a pressed state has changed.
+
+	/* Pre-rendered buttons (index*2 + down) and page text, so we only
+	 * rasterize glyphs when the page changes, not on every event. */
+	typedef std::unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)>
+		SurfacePtr;
+	std::vector<SurfacePtr> button_cache;
+	SurfacePtr text_cache;
+	Page cached_page;
 
 	Menu(int w, int h, cfg_t* config)
-		: w(w), h(h), config(config), page(Page::TOP) {
+		: w(w), h(h), config(config), page(Page::TOP), needs_paint(true),
+		text_cache(nullptr, SDL_FreeSurface), cached_page(Page::TOP) {
 
 		if(TTF_Init() != 0) { throw std::runtime_error(TTF_GetError()); }
 		const int kScaler = 10; // Smaller = larger fraction of the screen.
@@ -47,6 +57,9 @@ struct Menu : public Hack::Base {
 		q_x[2] = q_x[0]; q_y[2] = q_h + ((h*2)/kVSlices);
 		q_x[3] = q_x[1]; q_y[3] = q_y[2];
 		for(int i = 0; i < 4; ++i) { q_down[i] = false; }
+		for(int i = 0; i < 4*2; ++i) {
+			button_cache.emplace_back(nullptr, SDL_FreeSurface);
+		}
 	}
 
 	~Menu() {
@@ -56,16 +69,32 @@ struct Menu : public Hack::Base {
 
 	void simulate() override {}
 
-	void text_at(SDL_Surface* to, const char* text, int x, int y,
-		SDL_Color color, int wrap = 0) {
-
+	SDL_Surface* render_text(const char* text, SDL_Color color, int wrap) {
 		SDL_Surface* textsurf = TTF_RenderUTF8_Blended_Wrapped(
 			font, text, color, wrap);
 		if(textsurf == nullptr) { throw std::runtime_error(TTF_GetError()); }
-		SDL_Rect dstrect = { x, y, textsurf->w, textsurf->h };
-		if(SDL_BlitSurface(textsurf, nullptr, to, &dstrect) != 0)
+		return textsurf;
+	}
+
+	void blit_at(SDL_Surface* from, SDL_Surface* to, int x, int y) {
+		SDL_Rect dstrect = { x, y, from->w, from->h };
+		if(SDL_BlitSurface(from, nullptr, to, &dstrect) != 0)
 			{ throw std::runtime_error(SDL_GetError()); }
-		SDL_FreeSurface(textsurf);
+	}
+
+	void text_at(SDL_Surface* to, const char* text, int x, int y,
+		SDL_Color color, int wrap = 0) {
+
+		SurfacePtr textsurf(render_text(text, color, wrap), SDL_FreeSurface);
+		blit_at(textsurf.get(), to, x, y);
+	}
+
+	// Page text is drawn from the cache, rasterizing only on a miss.
+	void cached_text_at(SDL_Surface* to, const char* text, int x, int y,
+		SDL_Color color, int wrap = 0) {
+
+		if(!text_cache) { text_cache.reset(render_text(text, color, wrap)); }
+		blit_at(text_cache.get(), to, x, y);
 	}
 
 	Uint8 color_channel_brighten(Uint8 value, Sint16 add) {
@@ -118,7 +147,30 @@ struct Menu : public Hack::Base {
 		text_at(to, label, x + 8, y + 8, white, w - 16);
 	}
 
+	// Draw quarter button i from the cache, rendering it on a miss.
+	void cached_button(SDL_Surface* to, int i, const char* label,
+		SDL_Color color) {
+
+		SurfacePtr& cached = button_cache[(i*2) + (q_down[i] ? 1 : 0)];
+		if(!cached) {
+			cached.reset(SDL_CreateRGBSurfaceWithFormat(0, q_w, q_h,
+				to->format->BitsPerPixel, to->format->format));
+			if(!cached) { throw std::runtime_error(SDL_GetError()); }
+			// Buttons are opaque; don't pay for blending them every paint.
+			SDL_SetSurfaceBlendMode(cached.get(), SDL_BLENDMODE_NONE);
+			button(cached.get(), label, 0, 0, q_w, q_h, color, q_down[i]);
+		}
+		blit_at(cached.get(), to, q_x[i], q_y[i]);
+	}
+
 	void render(SDL_Surface* fb) override {
+		if(page != cached_page) {
+			for(auto&& cached : button_cache) { cached.reset(); }
+			text_cache.reset();
+			cached_page = page;
+		}
+		needs_paint = false;
+
 		SDL_FillRect(fb, nullptr, SDL_MapRGB(fb->format, 0x00, 0x00, 0x00));
 
 		SDL_Color whiteish  = { 0x70, 0x70, 0x70, 0xff };
@@ -134,8 +186,7 @@ struct Menu : public Hack::Base {
 				SDL_Color* colors[] =
 					{&blueish, &yellowish, &greenish, &reddish};
 				for(int i = 0; i < 4; ++i) {
-					button(fb, labels[i], q_x[i], q_y[i], q_w, q_h,
-						*colors[i], q_down[i]);
+					cached_button(fb, i, labels[i], *colors[i]);
 				}
 				} break;
 			case Page::CHOOSE_HACK: {
@@ -144,8 +195,7 @@ struct Menu : public Hack::Base {
 				SDL_Color* colors[] =
 					{&whiteish, &reddish, &greenish};
 				for(int i = 0; i < 3; ++i) {
-					button(fb, labels[i], q_x[i], q_y[i], q_w, q_h,
-						*colors[i], q_down[i]);
+					cached_button(fb, i, labels[i], *colors[i]);
 				}
 				} break;
 			case Page::SHUTDOWN: {
@@ -154,19 +204,19 @@ struct Menu : public Hack::Base {
 				SDL_Color* colors[] =
 					{&yellowish, &reddish, &greenish};
 				for(int i = 0; i < 3; ++i) {
-					button(fb, labels[i], q_x[i], q_y[i], q_w, q_h,
-						*colors[i], q_down[i]);
+					cached_button(fb, i, labels[i], *colors[i]);
 				}
 				} break;
 			case Page::SLEEP:
 				// This should end up being rendered *after* the backlight is
 				// off, but at least will become visible if it turns back on for
 				// some reason.
-				text_at(fb, "Sleeping; tap to wake", 8, 8, whiteish, w-16);
+				cached_text_at(fb, "Sleeping; tap to wake", 8, 8, whiteish,
+					w-16);
 				break;
 			case Page::POWEROFF:
 				// This should be visible until the init system kills us.
-				text_at(fb,
+				cached_text_at(fb,
 					"Shutting down\n\n"
 					"Unplug once screen blank and green LED stays off",
 					8, 8, whiteish, w-16);
@@ -225,6 +275,8 @@ struct Menu : public Hack::Base {
 		return MenuResult::RETURN_TO_HACK; // Should never happen™.
 	}
 
+	bool want_render() override { return needs_paint; }
+
 	// 50Hz, but not really; we only get to act on events.
 	Uint32 tick_duration() override { return 20; }
 
@@ -237,6 +289,7 @@ struct Menu : public Hack::Base {
 					for(int i = 0; i < 4; ++i) {
 						if((x >= q_x[i]) && (x <= q_x[i] + q_w)
 						&& (y >= q_y[i]) && (y <= q_y[i] + q_h)) {
+							needs_paint |= !q_down[i];
 							q_down[i] = true;
 						}
 					}
@@ -252,6 +305,7 @@ struct Menu : public Hack::Base {
 							// Nothing; but clear if we moved *out* of it.
 							// Does not implement re-entering the same button.
 						} else {
+							needs_paint |= q_down[i];
 							q_down[i] = false;
 						}
 					}
@@ -259,12 +313,15 @@ struct Menu : public Hack::Base {
 				break;
 			case SDL_MOUSEBUTTONUP: {
 				MenuResult result = MenuResult::KEEP_MENU;
+				Page previous_page = page;
 				for(int i = 0; i < 4; ++i) {
 					if(q_down[i]) {
 						result = click(i);
+						needs_paint = true;
 					}
 					q_down[i] = false;
 				}
+				needs_paint |= page != previous_page;
 				return result; }
 			default:
 				break;
@@ -273,6 +330,15 @@ struct Menu : public Hack::Base {
 	}
 
 	std::string next_hack() override { return next_hack_; }
+
+	// We're kept around between openings to keep the font loaded, so only
+	// the page state is reset.
+	void open_menu() override {
+		page = Page::TOP;
+		for(int i = 0; i < 4; ++i) { q_down[i] = false; }
+		next_hack_.clear();
+		needs_paint = true;
+	}
 };
 
 std::unique_ptr<Hack::Base> MakeMenu(int w, int h, void* config) {
@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+
+#include "overlay.hpp"
+
+constexpr int k_glyph_w = 3;
+constexpr int k_glyph_h = 5;
+constexpr int k_scale = 2; // Screen pixels per font pixel.
+constexpr int k_advance_x = (k_glyph_w + 1) * k_scale;
+constexpr int k_advance_y = (k_glyph_h + 2) * k_scale;
+constexpr int k_margin = 4;
+constexpr Uint32 k_update_ms = 1000;
+
+namespace {
+	// 3x5 pixels, rows top to bottom. Just enough for upper case, digits and
+	// the odd bit of punctuation; anything else draws as blank.
+	struct Glyph {
+		char c;
+		const char* rows;
+	};
+	const Glyph k_font[] = {
+		{'0', "XXX" "X.X" "X.X" "X.X" "XXX"},
+		{'1', ".X." "XX." ".X." ".X." "XXX"},
+		{'2', "XXX" "..X" "XXX" "X.." "XXX"},
+		{'3', "XXX" "..X" ".XX" "..X" "XXX"},
+		{'4', "X.X" "X.X" "XXX" "..X" "..X"},
+		{'5', "XXX" "X.." "XXX" "..X" "XXX"},
+		{'6', "XXX" "X.." "XXX" "X.X" "XXX"},
+		{'7', "XXX" "..X" "..X" ".X." ".X."},
+		{'8', "XXX" "X.X" "XXX" "X.X" "XXX"},
+		{'9', "XXX" "X.X" "XXX" "..X" "XXX"},
+		{'A', ".X." "X.X" "XXX" "X.X" "X.X"},
+		{'B', "XX." "X.X" "XX." "X.X" "XX."},
+		{'C', ".XX" "X.." "X.." "X.." ".XX"},
+		{'D', "XX." "X.X" "X.X" "X.X" "XX."},
+		{'E', "XXX" "X.." "XX." "X.." "XXX"},
+		{'F', "XXX" "X.." "XX." "X.." "X.."},
+		{'G', ".XX" "X.." "X.X" "X.X" ".XX"},
+		{'H', "X.X" "X.X" "XXX" "X.X" "X.X"},
+		{'I', "XXX" ".X." ".X." ".X." "XXX"},
+		{'J', "..X" "..X" "..X" "X.X" ".X."},
+		{'K', "X.X" "X.X" "XX." "X.X" "X.X"},
+		{'L', "X.." "X.." "X.." "X.." "XXX"},
+		{'M', "X.X" "XXX" "XXX" "X.X" "X.X"},
+		{'N', "XX." "X.X" "X.X" "X.X" "X.X"},
+		{'O', ".X." "X.X" "X.X" "X.X" ".X."},
+		{'P', "XX." "X.X" "XX." "X.." "X.."},
+		{'Q', ".X." "X.X" "X.X" "XX." ".XX"},
+		{'R', "XX." "X.X" "XX." "X.X" "X.X"},
+		{'S', ".XX" "X.." ".X." "..X" "XX."},
+		{'T', "XXX" ".X." ".X." ".X." ".X."},
+		{'U', "X.X" "X.X" "X.X" "X.X" "XXX"},
+		{'V', "X.X" "X.X" "X.X" "X.X" ".X."},
+		{'W', "X.X" "X.X" "XXX" "XXX" "X.X"},
+		{'X', "X.X" "X.X" ".X." "X.X" "X.X"},
+		{'Y', "X.X" "X.X" ".X." ".X." ".X."},
+		{'Z', "XXX" "..X" ".X." "X.." "XXX"},
+		{'.', "..." "..." "..." "..." ".X."},
+		{':', "..." ".X." "..." ".X." "..."},
+		{'/', "..X" "..X" ".X." "X.." "X.."},
+		{'-', "..." "..." "XXX" "..." "..."},
+	};
+
+	const char* glyph_rows(char c) {
+		c = std::toupper(static_cast<unsigned char>(c));
+		for(auto&& glyph : k_font) {
+			if(glyph.c == c) { return glyph.rows; }
+		}
+		return nullptr;
+	}
+
+	const Stats::Phase k_phases[] = {
+		Stats::Phase::SIMULATE, Stats::Phase::RENDER,
+		Stats::Phase::UPLOAD, Stats::Phase::PRESENT
+	};
+};
+
+Overlay::Overlay() : window_start_(0), frames_(0), previous_() {}
+
+void Overlay::update(Hack::Base* hack, Uint32 now) {
+	const Uint32 elapsed = now - window_start_;
+	if(!lines_.empty() && elapsed < k_update_ms) { return; }
+	char line[64];
+	lines_.clear();
+
+	std::snprintf(line, sizeof(line), "fps %.1f",
+		window_start_ == 0 ? 0.0 : (frames_ * 1000.0) / elapsed);
+	lines_.push_back(line);
+	// Mean over the second, from the change in the running totals.
+	for(Stats::Phase phase : k_phases) {
+		const Stats::Totals& totals = Stats::totals(phase);
+		Stats::Totals& previous = previous_[static_cast<int>(phase)];
+		const std::uint64_t count = totals.count - previous.count;
+		std::snprintf(line, sizeof(line), "%s %.2f ms", Stats::name(phase),
+			count ? ((totals.total_us - previous.total_us) / 1000.0) / count
+				: 0.0);
+		lines_.push_back(line);
+		previous = totals;
+	}
+	counters_.clear();
+	hack->counters(counters_);
+	for(auto&& counter : counters_) {
+		std::snprintf(line, sizeof(line), "%s %ld", counter.name,
+			counter.value);
+		lines_.push_back(line);
+	}
+
+	window_start_ = now;
+	frames_ = 0;
+}
+
+bool Overlay::due() const {
+	return lines_.empty() || SDL_GetTicks() - window_start_ >= k_update_ms;
+}
+
+void Overlay::draw_text(SDL_Surface* fb, int x, int y,
+	const std::string& text, Uint32 color) {
+	for(char c : text) {
+		if(const char* rows = glyph_rows(c)) {
+			for(int gy = 0; gy < k_glyph_h; ++gy) {
+				for(int gx = 0; gx < k_glyph_w; ++gx) {
+					if(rows[(gy * k_glyph_w) + gx] != 'X') { continue; }
+					SDL_Rect pixel = {
+						static_cast<Sint16>(x + (gx * k_scale)),
+						static_cast<Sint16>(y + (gy * k_scale)),
+						k_scale, k_scale};
+					SDL_FillRect(fb, &pixel, color);
+				}
+			}
+		}
+		x += k_advance_x;
+	}
+}
+
+void Overlay::draw(SDL_Surface* fb, Hack::Base* hack) {
+	Stats::enable();
+	++frames_;
+	update(hack, SDL_GetTicks());
+
+	size_t longest = 0;
+	for(auto&& line : lines_) { longest = std::max(longest, line.size()); }
+	SDL_Rect box = {0, 0,
+		static_cast<Uint16>((longest * k_advance_x) + (2 * k_margin)),
+		static_cast<Uint16>((lines_.size() * k_advance_y) + (2 * k_margin))};
+	SDL_FillRect(fb, &box, SDL_MapRGB(fb->format, 0, 0, 0));
+	const Uint32 color = SDL_MapRGB(fb->format, 0xff, 0xff, 0x40);
+	int y = k_margin;
+	for(auto&& line : lines_) {
+		draw_text(fb, k_margin, y, line, color);
+		y += k_advance_y;
+	}
+}
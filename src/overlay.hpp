@@ -0,0 +1,39 @@
+#ifndef OVERLAY_HPP_
+#define OVERLAY_HPP_
+
+/* Diagnostics drawn over the hack's frame: frame rate, time per phase, and
+ * whatever counters the hack publishes. For looking into stutter on a
+ * deployed clock without attaching a debugger. It has its own tiny built-in
+ * font, drawn as rectangles, so it costs little and doesn't need SDL_ttf.
+ * Figures are averaged over, and updated, once a second, to be readable.
+ */
+
+#include <string>
+#include <vector>
+
+#include "hack.hpp"
+#include "stats.hpp"
+
+class Overlay {
+	Uint32 window_start_; // SDL_GetTicks() when the current second began.
+	int frames_;
+	Stats::Totals previous_[static_cast<int>(Stats::Phase::COUNT)];
+	Hack::Counters counters_;
+	std::vector<std::string> lines_;
+
+	void update(Hack::Base* hack, Uint32 now);
+	void draw_text(SDL_Surface* fb, int x, int y, const std::string& text,
+		Uint32 color);
+
+public:
+	Overlay();
+
+	// Draw into a frame the hack has just rendered. Turns on Stats, which the
+	// phase times come from.
+	void draw(SDL_Surface* fb, Hack::Base* hack);
+	// Whether the figures are due their update, so a frame should be drawn
+	// even if the hack has nothing new to show (e.g. while it's idle).
+	bool due() const;
+};
+
+#endif
@@ -6,6 +6,7 @@
 // Force VSCode to know this is going to get the version 1 define here.
 #define SDLVERSION 1
 #include "hack.hpp"
+#include "wallclock.hpp"
 
 // This is just used to get SDL init/deinit via RAII for nice error handling
 namespace SDL {
@@ -97,6 +98,7 @@ int main(int argc, char** argv) {
 			}
 			do {
 				tickerror -= hack->tick_duration();
+				WallClock::shared().tick();
 				hack->simulate();
 			} while(tickerror >= hack->tick_duration());
 
@@ -1,7 +1,23 @@
 // Copyright (c) 2023 Philip Boulain; see LICENSE for terms.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
 #include <exception>
+#include <functional>
+#include <future>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
 
 // The cryptic Reason for menu only with SDL 2 is somewhat that I don't want to
 // pull this lib into the very embedded Tontec framebuffer version.
@@ -9,9 +25,31 @@
 
 // Force VSCode to know this is going to get the version 2 define here.
 #define SDLVERSION 2
+#include "framebuffer.hpp"
+#include "framedump.hpp"
 #include "hack.hpp"
+#include "overlay.hpp"
+#include "snapshot.hpp"
+#include "stats.hpp"
+#include "touch.hpp"
+#include "trace.hpp"
+#include "wallclock.hpp"
 
 const char* kConfigFile = "~/.config/pixmas.conf";
+// How much memory suspended hacks may hold on to for quick switching back.
+constexpr size_t k_hack_cache_budget = 32 * 1024 * 1024;
+// How often to draw between ticks, for hacks that can (~60Hz).
+constexpr Uint32 k_interpolated_frame_ms = 16;
+// How often to look for input while waiting, where SDL can't wait for it.
+constexpr Uint32 k_wait_slice_ms = 33;
+// How long the menu waits for input before looking for a trace dump request.
+constexpr Uint32 k_menu_wait_ms = 1000;
+// How often to catch a hack up with the screen off, and for how long at most
+// (under 1% of the time); and how long it may take on the way back from the
+// menu. See CatchUp.
+constexpr Uint32 k_catch_up_batch_ms = 10 * 60 * 1000;
+constexpr Uint32 k_catch_up_batch_budget_ms = 5000;
+constexpr Uint32 k_catch_up_budget_ms = 100;
 
 #ifdef DESKTOP
 const char* kCommandBacklightOn = "echo fake backlight on 2>&1";
@@ -31,82 +69,495 @@ namespace SDL {
 	};
 
 	struct Graphics {
-		SDL_Window* window;
-		SDL_Renderer *renderer;
+		SDL_Window* window; // Null when offscreen or on fbdev.
+		SDL_Renderer *renderer; // Null on fbdev; likewise the texture.
+		// What an offscreen software renderer draws to, in place of a window.
+		SDL_Surface* target;
+		// Used directly instead of SDL's rendering, for the fbdev backend.
+		std::unique_ptr<Framebuffer> framebuffer;
+		int scale;
 		SDL_Texture* texture;
+		// Format of the texture, owned here so hacks can be built without
+		// locking the texture (and so off the main thread).
+		SDL_PixelFormat* format;
 		int w, h;
 
-		Graphics() {
+		/* How frames get into the texture. Either lock it and point a
+		 * long-lived surface header at its pixels (rather than have
+		 * SDL_LockTextureToSurface make and free one every frame), or render
+		 * to our own framebuffer and SDL_UpdateTexture it up. Which is cheaper
+		 * depends on the renderer, so by default we time both. On fbdev
+		 * there's no texture, and our framebuffer goes to the device. */
+		enum class Upload { LOCK, UPDATE, FBDEV };
+		Upload upload;
+		SDL_Surface* view; // For LOCK; pixels are only valid mid-frame.
+		SDL_Surface* cpu_fb; // For UPDATE and FBDEV.
+
+		FrameDump* dump; // Gets a copy of every frame rendered, if set.
+		// Whether SDL_WaitEventTimeout really sleeps until an event or the
+		// timeout. Otherwise (e.g. the dummy driver, under offscreen and
+		// fbdev) it polls every millisecond; see wait_event().
+		bool wait_blocks;
+
+		// Hacks get the output size divided by pixel_scale, and are scaled
+		// back up (chunkily) by the GPU, costing pixel_scale squared less.
+		// The "offscreen" backend has no window at all, and renders in
+		// software to a surface, so the whole thing can run on a headless
+		// machine. "fbdev" writes straight to the framebuffer device at
+		// fbdev_path, bypassing SDL's rendering (and scaling up itself).
+		// Anything else is "window".
+		Graphics(const std::string& backend, const std::string& fbdev_path,
+			const std::string& upload_mode, int pixel_scale) :
+			window(nullptr), renderer(nullptr), target(nullptr),
+			scale(std::max(1, pixel_scale)), texture(nullptr),
+			dump(nullptr) {
+			const bool offscreen = backend == "offscreen";
+			const bool fbdev = backend == "fbdev";
+			if(!offscreen && !fbdev && backend != "window") {
+				std::cerr << "Unknown backend '" << backend
+					<< "', using a window" << std::endl;
+			}
+			// Events still need a video driver, just not a real one.
+			if(offscreen || fbdev) { setenv("SDL_VIDEODRIVER", "dummy", 1); }
 			if(SDL_Init(SDL_INIT_VIDEO) != 0) { throw Error(); }
-			if(SDL_CreateWindowAndRenderer(
-#ifdef DESKTOP
+			wait_blocks = driver_wait_blocks();
+			if(fbdev) {
+				framebuffer.reset(new Framebuffer(fbdev_path));
+			} else if(offscreen) {
 				// Resolution of the Pimoroni HyperPixel.
-				800, 480,
-				0,
+				target = SDL_CreateRGBSurfaceWithFormat(0, 800, 480, 32,
+					SDL_PIXELFORMAT_ARGB8888);
+				if(target == nullptr) { throw Error(); }
+				renderer = SDL_CreateSoftwareRenderer(target);
+				if(renderer == nullptr) { throw Error(); }
+			} else {
+				if(SDL_CreateWindowAndRenderer(
+#ifdef DESKTOP
+					800, 480, // As offscreen.
+					0,
 #else
-				// Counterintuitively, the non-"desktop" behaviour is fullscreen.
-				0, 0,
-				SDL_WINDOW_FULLSCREEN_DESKTOP,
+					// Counterintuitively, the non-"desktop" behaviour is
+					// fullscreen.
+					0, 0,
+					SDL_WINDOW_FULLSCREEN_DESKTOP,
 #endif
-				&window, &renderer) != 0 ) { throw Error(); }
-			SDL_SetWindowTitle(window, "pixmas");
+					&window, &renderer) != 0 ) { throw Error(); }
+				SDL_SetWindowTitle(window, "pixmas");
 #ifndef DESKTOP
-			SDL_SetWindowAlwaysOnTop(window, SDL_TRUE);
+				SDL_SetWindowAlwaysOnTop(window, SDL_TRUE);
 #endif
-			if(SDL_GetRendererOutputSize(renderer, &w, &h) != 0)
-				{ throw Error(); }
-			texture = SDL_CreateTexture(renderer,
-							SDL_PIXELFORMAT_ARGB8888,
-							SDL_TEXTUREACCESS_STREAMING,
-							w, h);
+			}
+			if(framebuffer) {
+				w = std::max(1, framebuffer->w() / scale);
+				h = std::max(1, framebuffer->h() / scale);
+			} else {
+				if(SDL_GetRendererOutputSize(renderer, &w, &h) != 0)
+					{ throw Error(); }
+				if(scale > 1) {
+					w = std::max(1, w / scale);
+					h = std::max(1, h / scale);
+					// Also maps input events back into our smaller
+					// co-ordinates.
+					if(SDL_RenderSetLogicalSize(renderer, w, h) != 0)
+						{ throw Error(); }
+					// Else the rounding down above leaves it stretching
+					// by a fraction over scale, and pixels come out
+					// uneven sizes. This way, the spare is a border.
+					if(SDL_RenderSetIntegerScale(renderer, SDL_TRUE) != 0)
+						{ throw Error(); }
+				}
+				// Nearest-neighbour, for the pixel look. (Usually the
+				// default.)
+				SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+				texture = SDL_CreateTexture(renderer,
+								SDL_PIXELFORMAT_ARGB8888,
+								SDL_TEXTUREACCESS_STREAMING,
+								w, h);
+				if(texture == nullptr) { throw Error(); }
+			}
+			format = SDL_AllocFormat(SDL_PIXELFORMAT_ARGB8888);
+			if(format == nullptr) { throw Error(); }
+
+			view = SDL_CreateRGBSurfaceWithFormatFrom(nullptr, w, h, 32, w*4,
+				SDL_PIXELFORMAT_ARGB8888);
+			if(view == nullptr) { throw Error(); }
+			cpu_fb = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32,
+				SDL_PIXELFORMAT_ARGB8888);
+			if(cpu_fb == nullptr) { throw Error(); }
+			if(framebuffer) {
+				upload = Upload::FBDEV;
+			} else if(upload_mode == "lock") {
+				upload = Upload::LOCK;
+			} else if(upload_mode == "update") {
+				upload = Upload::UPDATE;
+			} else {
+				if(upload_mode != "auto") {
+					std::cerr << "Unknown upload mode '" << upload_mode
+						<< "', timing them instead" << std::endl;
+				}
+				upload = calibrate_upload();
+			}
 		}
 		~Graphics() {
+			SDL_FreeSurface(cpu_fb);
+			SDL_FreeSurface(view);
+			SDL_FreeFormat(format);
+			if(target) {
+				// Not tied to a window, so SDL_Quit won't find it.
+				SDL_DestroyRenderer(renderer);
+				SDL_FreeSurface(target);
+			}
 			// Let SDL free all its own things.
 			SDL_Quit();
 		}
+
+		// Only drivers SDL can wake from a wait implement one (since 2.0.16).
+		static bool driver_wait_blocks() {
+			SDL_version version;
+			SDL_GetVersion(&version);
+			if(version.major == 2 && version.minor == 0 && version.patch < 16) {
+				return false;
+			}
+			const char* driver = SDL_GetCurrentVideoDriver();
+			if(driver == nullptr) { return false; }
+			for(const char* blocking : { "x11", "wayland", "windows", "cocoa" }) {
+				if(SDL_strcasecmp(driver, blocking) == 0) { return true; }
+			}
+			return false;
+		}
+
+		// Sleep until there's an event waiting (left queued), or for ms.
+		// Returns whether there is one. Where SDL's wait would spin, nap in
+		// slices instead, looking in between, so input (such as touches
+		// pushed from another thread) still gets a prompt answer.
+		bool wait_event(Uint32 ms) {
+			if(wait_blocks) { return SDL_WaitEventTimeout(nullptr, ms) == 1; }
+			const Uint32 begin = SDL_GetTicks();
+			while(true) {
+				SDL_PumpEvents();
+				if(SDL_HasEvents(SDL_FIRSTEVENT, SDL_LASTEVENT)) { return true; }
+				const Uint32 waited = SDL_GetTicks() - begin;
+				if(waited >= ms) { return false; }
+				SDL_Delay(std::min(k_wait_slice_ms, ms - waited));
+			}
+		}
+
+		// Get the surface to render this frame into.
+		SDL_Surface* begin_frame() {
+			if(upload != Upload::LOCK) { return cpu_fb; }
+			void* pixels;
+			int pitch;
+			if(SDL_LockTexture(texture, nullptr, &pixels, &pitch) != 0)
+				{ throw Error(); }
+			view->pixels = pixels;
+			view->pitch = pitch;
+			return view;
+		}
+
+		// Get what was rendered into the texture (or onto the display).
+		void end_frame() {
+			switch(upload) {
+				case Upload::LOCK:
+					SDL_UnlockTexture(texture);
+					view->pixels = nullptr;
+					break;
+				case Upload::UPDATE:
+					if(SDL_UpdateTexture(texture, nullptr, cpu_fb->pixels,
+						cpu_fb->pitch) != 0) { throw Error(); }
+					break;
+				case Upload::FBDEV:
+					framebuffer->present(cpu_fb, scale);
+					break;
+			}
+		}
+
+		// Show the frame. On fbdev, end_frame already has.
+		void present() {
+			if(!renderer) { return; }
+			{
+				Trace::Span span("render copy");
+				SDL_RenderClear(renderer);
+				SDL_RenderCopy(renderer, texture, NULL, NULL);
+			}
+			Trace::Span span("present");
+			SDL_RenderPresent(renderer);
+		}
+
+		// Time a few frames of each upload mode, and pick the cheaper.
+		Upload calibrate_upload() {
+			constexpr int k_frames = 10;
+			const Upload modes[] = { Upload::LOCK, Upload::UPDATE };
+			Uint64 cost[2];
+			for(int m = 0; m < 2; ++m) {
+				upload = modes[m];
+				Uint64 start = 0;
+				// The first frame is a warm-up, and not counted.
+				for(int i = 0; i <= k_frames; ++i) {
+					if(i == 1) { start = SDL_GetPerformanceCounter(); }
+					SDL_FillRect(begin_frame(), nullptr, 0);
+					end_frame();
+					SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+					// Renderers batch; without this the upload might not
+					// happen until after we've stopped timing.
+					SDL_RenderFlush(renderer);
+				}
+				cost[m] = SDL_GetPerformanceCounter() - start;
+			}
+			const double ms_per_tick = 1000.0 / SDL_GetPerformanceFrequency();
+			std::cerr << "Upload per frame: lock "
+				<< (cost[0] * ms_per_tick) / k_frames << "ms, update "
+				<< (cost[1] * ms_per_tick) / k_frames << "ms; using "
+				<< (cost[0] <= cost[1] ? "lock" : "update") << std::endl;
+			return cost[0] <= cost[1] ? Upload::LOCK : Upload::UPDATE;
+		}
 	};
 };
 
-std::unique_ptr<Hack::Base> change_hack(SDL::Graphics& graphics,
-	std::string hackname) {
-
-	std::unique_ptr<Hack::Base> hack;
-	SDL_Surface* tmp_fb = nullptr;
-	if(SDL_LockTextureToSurface(graphics.texture, NULL, &tmp_fb) != 0)
-		{ throw std::runtime_error(SDL_GetError()); }
+// Doesn't touch the renderer, so is safe to run on a worker thread.
+std::unique_ptr<Hack::Base> make_hack(int w, int h, SDL_PixelFormat* format,
+	std::string hackname, Hack::Params params) {
 
 	// (Still can't be bothered to set up a self-registering factory.)
 	if(hackname == "snowfp") {
-		hack = Hack::MakeSnowFP(graphics.w, graphics.h, tmp_fb->format);
+		return Hack::MakeSnowFP(w, h, format, params);
 	} else if(hackname == "snowint") {
-		hack = Hack::MakeSnowInt(graphics.w, graphics.h, tmp_fb->format);
+		return Hack::MakeSnowInt(w, h, format, params);
 	} else if(hackname == "snowclock") {
-		hack = Hack::MakeSnowClock(graphics.w, graphics.h);
+		return Hack::MakeSnowClock(w, h, params);
 	} else if(hackname == "popclock") {
-		hack = Hack::MakePopClock(graphics.w, graphics.h);
+		return Hack::MakePopClock(w, h, params);
 	} else if(hackname == "colorcycle") {
-		hack = Hack::MakeColorCycle();
+		return Hack::MakeColorCycle();
 	} else {
 		std::cerr << "Unknown hack '" << hackname << "'" << std::endl;
-		hack = Hack::MakeColorCycle();
+		return Hack::MakeColorCycle();
+	}
+}
+
+const char* kHackNames[] =
+	{"snowfp", "snowint", "snowclock", "popclock", "colorcycle"};
+
+const Hack::ParamSchema& hack_param_schema(const std::string& hackname) {
+	static const Hack::ParamSchema none;
+	if(hackname == "snowfp") {
+		return Hack::SnowFPParams();
+	} else if(hackname == "snowint") {
+		return Hack::SnowIntParams();
+	} else if(hackname == "snowclock") {
+		return Hack::SnowClockParams();
+	} else if(hackname == "popclock") {
+		return Hack::PopClockParams();
+	} else {
+		return none;
+	}
+}
+
+// libconfuse wants option tables that outlive the cfg_t, so this holds them.
+// Each hack with params gets a section of its own, named after it.
+struct ConfigSchema {
+	std::vector<std::vector<cfg_opt_t>> sections;
+	std::vector<cfg_opt_t> options;
+
+	ConfigSchema() {
+		options.push_back(CFG_STR("hack", "snowclock", CFGF_NONE));
+		// Where frames go: "window", "fbdev" for straight to a framebuffer
+		// device, or "offscreen" for nowhere at all.
+		options.push_back(CFG_STR("backend", "window", CFGF_NONE));
+		// The device for backend = "fbdev".
+		options.push_back(CFG_STR("fbdev", "/dev/fb1", CFGF_NONE));
+		// And its touchscreen's evdev device; empty looks for one.
+		options.push_back(CFG_STR("touch", "", CFGF_NONE));
+		// How to get frames into the texture: "lock", "update", or "auto".
+		options.push_back(CFG_STR("upload", "auto", CFGF_NONE));
+		// Integer factor to shrink the hacks' resolution by.
+		options.push_back(CFG_INT("pixel_scale", 1, CFGF_NONE));
+		// Show the performance overlay from the start (o toggles it).
+		options.push_back(CFG_BOOL("overlay", cfg_false, CFGF_NONE));
+		for(const char* hackname : kHackNames) {
+			const Hack::ParamSchema& schema = hack_param_schema(hackname);
+			if(schema.empty()) { continue; }
+			std::vector<cfg_opt_t> section;
+			for(auto&& param : schema) {
+				switch(param.type) {
+					case Hack::Param::Type::INT: {
+						cfg_opt_t opt = CFG_INT(param.name,
+							static_cast<long>(param.default_value), CFGF_NONE);
+						section.push_back(opt);
+						} break;
+					case Hack::Param::Type::FLOAT: {
+						cfg_opt_t opt = CFG_FLOAT(param.name,
+							param.default_value, CFGF_NONE);
+						section.push_back(opt);
+						} break;
+					case Hack::Param::Type::BOOL: {
+						cfg_opt_t opt = CFG_BOOL(param.name,
+							param.default_value != 0.0 ? cfg_true : cfg_false,
+							CFGF_NONE);
+						section.push_back(opt);
+						} break;
+				}
+			}
+			cfg_opt_t end = CFG_END();
+			section.push_back(end);
+			// The inner vector's storage doesn't move when sections grows.
+			sections.push_back(std::move(section));
+			cfg_opt_t opt = CFG_SEC(hackname, sections.back().data(),
+				CFGF_NONE);
+			options.push_back(opt);
+		}
+		cfg_opt_t end = CFG_END();
+		options.push_back(end);
 	}
+};
 
-	SDL_UnlockTexture(graphics.texture);
-	return hack;
+// Read the hack's section of the config (on the main thread; libconfuse isn't
+// something to share with the builder thread).
+Hack::Params hack_params(cfg_t* config, const std::string& hackname) {
+	Hack::Params params;
+	const Hack::ParamSchema& schema = hack_param_schema(hackname);
+	if(schema.empty()) { return params; }
+	cfg_t* section = cfg_getsec(config, hackname.c_str());
+	for(auto&& param : schema) {
+		double value = 0;
+		switch(param.type) {
+			case Hack::Param::Type::INT:
+				value = cfg_getint(section, param.name);
+				break;
+			case Hack::Param::Type::FLOAT:
+				value = cfg_getfloat(section, param.name);
+				break;
+			case Hack::Param::Type::BOOL:
+				value = cfg_getbool(section, param.name);
+				break;
+		}
+		// The hacks trust these, e.g. a zero tick_duration would hang.
+		const double clamped =
+			std::min(param.max_value, std::max(param.min_value, value));
+		if(clamped != value) {
+			std::cerr << hackname << " " << param.name << " = " << value
+				<< " is out of range; using " << clamped << std::endl;
+		}
+		params.set(param.name, clamped);
+	}
+	return params;
 }
 
-void render_hack(SDL::Graphics& graphics, Hack::Base* hack) {
-	if(hack->want_render()) {
-		SDL_Surface* fb = nullptr;
-		if(SDL_LockTextureToSurface(graphics.texture, NULL, &fb) != 0)
-			{ throw std::runtime_error(SDL_GetError()); }
-		hack->render(fb);
-		SDL_UnlockTexture(graphics.texture); // Also frees fb
-		fb = nullptr;
-		SDL_RenderClear(graphics.renderer);
-		SDL_RenderCopy(graphics.renderer, graphics.texture,
-			NULL, NULL);
-		SDL_RenderPresent(graphics.renderer);
+// Switches between hacks without stalling the display. New ones are built on a
+// worker thread while the current one keeps running, and recently used ones
+// are kept suspended, up to a memory budget, so switching back to them is
+// instant and they carry on where they left off.
+class HackSwitcher {
+	struct Suspended {
+		std::string name;
+		std::unique_ptr<Hack::Base> hack;
+	};
+	struct Building {
+		std::string name;
+		std::future<std::unique_ptr<Hack::Base>> hack;
+	};
+	std::vector<Suspended> suspended_; // Most recently used first.
+	std::vector<Building> building_;
+	std::unique_ptr<Hack::Base> hack_;
+	std::string name_;
+	std::string wanted_; // The latest choice; builds of anything else are old.
+
+	void suspend(std::string name, std::unique_ptr<Hack::Base> hack) {
+		suspended_.insert(suspended_.begin(), Suspended{name, std::move(hack)});
+		// Evict least recently used down to the budget. This can evict what
+		// was just put in if it alone is too big, which is the right call.
+		size_t total = 0;
+		auto it = suspended_.begin();
+		for(; it != suspended_.end(); ++it) {
+			total += it->hack->memory_footprint();
+			if(total > k_hack_cache_budget) { break; }
+		}
+		suspended_.erase(it, suspended_.end());
+	}
+
+	void swap(std::string name, std::unique_ptr<Hack::Base> next) {
+		if(hack_) { suspend(name_, std::move(hack_)); }
+		hack_ = std::move(next);
+		name_ = name;
+		hack_->resume();
+	}
+
+public:
+	// The initial hack is built synchronously, since there's nothing to show
+	// until it exists.
+	HackSwitcher(SDL::Graphics& graphics, std::string name,
+		Hack::Params params) :
+		hack_(make_hack(graphics.w, graphics.h, graphics.format, name,
+			params)),
+		name_(name), wanted_(name) {}
+
+	Hack::Base* hack() { return hack_.get(); }
+
+	void select(SDL::Graphics& graphics, std::string name,
+		Hack::Params params) {
+		// Whichever way it's got, this supersedes anything building.
+		wanted_ = name;
+		if(name == name_) { return; } // Already running; leave it be.
+		for(auto it = suspended_.begin(); it != suspended_.end(); ++it) {
+			if(it->name == name) {
+				std::unique_ptr<Hack::Base> next = std::move(it->hack);
+				suspended_.erase(it);
+				swap(name, std::move(next));
+				return;
+			}
+		}
+		// Already on its way; a second would map the same snapshot file.
+		for(auto&& build : building_) {
+			if(build.name == name) { return; }
+		}
+		// Anything else building is left to finish (a std::async future
+		// can't be abandoned without waiting on it), and dropped by poll().
+		building_.push_back(Building{name, std::async(std::launch::async,
+			make_hack, graphics.w, graphics.h, graphics.format, name,
+			params)});
+	}
+
+	// Switch to the hack being built if it has finished, and let go of any
+	// finished builds that have been chosen over since.
+	void poll() {
+		for(auto it = building_.begin(); it != building_.end();) {
+			if(it->hack.wait_for(std::chrono::seconds(0))
+				!= std::future_status::ready) { ++it; continue; }
+			Building built = std::move(*it);
+			it = building_.erase(it);
+			// Rethrows if construction failed.
+			if(built.name == wanted_) { swap(built.name, built.hack.get()); }
+		}
+	}
+};
+
+void render_hack(SDL::Graphics& graphics, Hack::Base* hack,
+	Overlay* overlay = nullptr, double alpha = 1.0) {
+	// The overlay's figures keep updating even if the hack's picture doesn't.
+	if(hack->want_render() || (overlay && overlay->due())) {
+		SDL_Surface* fb;
+		{
+			Stats::Scope timing(Stats::Phase::RENDER);
+			Trace::Span span("render");
+			fb = graphics.begin_frame();
+			hack->render_between(fb, alpha);
+		}
+		if(overlay) {
+			// Not counted as rendering, which it would skew.
+			Trace::Span span("overlay");
+			overlay->draw(fb, hack);
+		}
+		if(graphics.dump) {
+			// Before the upload, while a locked texture is still readable.
+			Trace::Span span("dump");
+			graphics.dump->push(fb);
+		}
+		{
+			Stats::Scope timing(Stats::Phase::UPLOAD);
+			Trace::Span span("upload");
+			graphics.end_frame();
+		}
+		Stats::Scope timing(Stats::Phase::PRESENT);
+		graphics.present();
 	}
 }
 
@@ -144,40 +595,238 @@ void shutdown() {
 	try_system(kCommandShutdown);
 }
 
-void save_config(cfg_t* config) {
-	// Look out, it's C.
-	char* expanded = cfg_tilde_expand(kConfigFile);
-	FILE *fp = fopen(expanded, "w");
-	free(expanded);
-	cfg_print(config, fp);
-	fclose(fp);
-}
+// Writes the config out on a background thread, so a slow SD card can't hold
+// up responding to touches. Bursts of saves only write out the latest one.
+class ConfigWriter {
+	std::string path_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::string pending_;
+	bool has_pending_;
+	bool quit_;
+	std::thread thread_;
+
+	// Write to a temporary file and rename it over, so a power cut mid-write
+	// leaves either the old config or the new one, never half of one.
+	static void write_atomically(const std::string& path,
+		const std::string& contents) {
+
+		std::string temp_path = path + ".tmp";
+		FILE* fp = fopen(temp_path.c_str(), "w");
+		if(fp == nullptr) {
+			std::cerr << "Can't write '" << temp_path << "': "
+				<< strerror(errno) << std::endl;
+			return;
+		}
+		bool ok = fwrite(contents.data(), 1, contents.size(), fp)
+			== contents.size();
+		ok &= fflush(fp) == 0;
+		ok &= fsync(fileno(fp)) == 0;
+		ok &= fclose(fp) == 0;
+		if(!ok || rename(temp_path.c_str(), path.c_str()) != 0) {
+			std::cerr << "Can't save config to '" << path << "': "
+				<< strerror(errno) << std::endl;
+			remove(temp_path.c_str());
+		}
+	}
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		while(true) {
+			wake_.wait(lock, [&]{ return has_pending_ || quit_; });
+			if(has_pending_) {
+				std::string contents;
+				contents.swap(pending_);
+				has_pending_ = false;
+				// Let more saves queue up (and replace this one) meanwhile.
+				lock.unlock();
+				write_atomically(path_, contents);
+				lock.lock();
+			} else {
+				return; // Quitting, and nothing left to write.
+			}
+		}
+	}
+
+public:
+	// A null path writes nothing, for runs that shouldn't touch the config.
+	explicit ConfigWriter(const char* path) :
+		has_pending_(false), quit_(false) {
+
+		if(path != nullptr) {
+			// Look out, it's C.
+			char* expanded = cfg_tilde_expand(path);
+			path_ = expanded;
+			free(expanded);
+		}
+		thread_ = std::thread(&ConfigWriter::run, this);
+	}
+
+	~ConfigWriter() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			quit_ = true;
+		}
+		wake_.notify_one();
+		thread_.join(); // Finishes off any pending write first.
+	}
+
+	// Serializes the config now (in memory, so cheap), and writes it later.
+	void save(cfg_t* config) {
+		if(path_.empty()) { return; }
+		char* buffer = nullptr;
+		size_t size = 0;
+		FILE* fp = open_memstream(&buffer, &size);
+		if(fp == nullptr) {
+			std::cerr << "Can't serialize config: " << strerror(errno)
+				<< std::endl;
+			return;
+		}
+		cfg_print(config, fp);
+		fclose(fp);
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			pending_.assign(buffer, size);
+			has_pending_ = true;
+		}
+		free(buffer);
+		wake_.notify_one();
+	}
+};
+
+/* Catches a hack frozen under the menu up on the time it's missed, so e.g. a
+ * clock left with the screen off overnight shows the night's snow on waking.
+ * With the screen off a worker thread fast-forwards it every
+ * k_catch_up_batch_ms, for up to k_catch_up_batch_budget_ms, skipping what it
+ * doesn't get through: screen off is meant to save power, so this only buys
+ * as much of the missed time as that small a duty allows (all of it, for
+ * hacks that idle cheaply). Whatever's left on the way back is run on the
+ * main thread, for up to k_catch_up_budget_ms, so there's no visible stall;
+ * any more than that is skipped, as it always used to be. While the worker
+ * runs, it owns the hack and the shared WallClock. */
+class CatchUp {
+	Hack::Base* hack_;
+	Uint32 tick_ms_;
+	std::time_t frozen_at_; // Wall clock time of the first missed tick.
+	Uint32 frozen_ms_; // And SDL_GetTicks() at it.
+	Uint32 done_; // Missed ticks run so far.
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	std::atomic<bool> quit_;
+	std::thread thread_;
+
+	Uint32 due() const { return (SDL_GetTicks() - frozen_ms_) / tick_ms_; }
+
+	// Run missed ticks up to due, or until keep_going() says otherwise.
+	void run_to(Uint32 due, const std::function<bool()>& keep_going) {
+		if(due <= done_) { return; }
+		Trace::Span span("catch up");
+		Uint32 next = done_;
+		done_ += hack_->fast_forward(due - done_, [&]{
+			if(!keep_going()) { return false; }
+			WallClock::shared().tick(frozen_at_
+				+ ((static_cast<Uint64>(next++) * tick_ms_) / 1000));
+			return true;
+		});
+	}
+
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex_);
+		while(!quit_) {
+			lock.unlock();
+			const Uint32 begin = SDL_GetTicks();
+			const Uint32 due_now = due();
+			run_to(due_now, [&]{
+				return !quit_
+					&& SDL_GetTicks() - begin < k_catch_up_batch_budget_ms;
+			});
+			// Out of time for this batch; let the rest go.
+			if(!quit_) { done_ = std::max(done_, due_now); }
+			lock.lock();
+			wake_.wait_for(lock, std::chrono::milliseconds(k_catch_up_batch_ms),
+				[&]{ return quit_.load(); });
+		}
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			quit_ = true;
+		}
+		wake_.notify_one();
+		if(thread_.joinable()) { thread_.join(); }
+	}
+
+public:
+	// Call as the hack is frozen.
+	explicit CatchUp(Hack::Base* hack) :
+		hack_(hack), tick_ms_(hack->tick_duration()),
+		frozen_at_(std::time(nullptr)), frozen_ms_(SDL_GetTicks()), done_(0),
+		quit_(false) {}
+	// Abandons catching up, if it wasn't finished.
+	~CatchUp() { stop(); }
+	CatchUp(const CatchUp&) = delete;
+	CatchUp& operator=(const CatchUp&) = delete;
+
+	// Start keeping up in the background, as nothing's being shown.
+	void start() {
+		if(!thread_.joinable()) { thread_ = std::thread(&CatchUp::run, this); }
+	}
+
+	// Catch up as far as we can and hand the hack back to be run as normal.
+	void finish() {
+		stop();
+		const Uint32 begin = SDL_GetTicks();
+		run_to(due(), [&]{
+			return SDL_GetTicks() - begin < k_catch_up_budget_ms;
+		});
+	}
+};
 
 // Different event loop logic and nesting to preserve underlying hack.
-void menu(SDL::Graphics& graphics, cfg_t* config,
-	std::unique_ptr<Hack::Base>& hack) {
+// The menu itself persists between calls so it opens without reloading fonts.
+// tapped_at is the SDL_GetTicks() timestamp of the tap that opened it.
+void menu(SDL::Graphics& graphics, cfg_t* config, ConfigWriter& config_writer,
+	HackSwitcher& hacks, Hack::Base* menu_hack, Uint32 tapped_at) {
 
-	std::unique_ptr<Hack::Base> menu_hack =
-		Hack::MakeMenu(graphics.w, graphics.h, config);
-	render_hack(graphics, menu_hack.get());
+	CatchUp catch_up(hacks.hack());
+	bool back_to_hack = true; // Rather than a different one, or quitting.
+	menu_hack->open_menu();
+	render_hack(graphics, menu_hack);
+	// From the tap, not from getting here, so however long the main loop
+	// took to notice it (e.g. mid idle wait) counts too. Only to the
+	// millisecond, as that's what event timestamps have.
+	if(Stats::enabled()) {
+		Stats::record(Stats::Phase::MENU_OPEN,
+			static_cast<std::uint64_t>(SDL_GetTicks() - tapped_at) * 1000);
+	}
 	SDL_Event event;
 	bool run = true;
 	// Process events; blocking, unlike below, and interruptable by the run flag
-	// inbetween each individual event.
-	while(run && SDL_WaitEvent(&event)) {
+	// inbetween each individual event. The wait times out now and then, so
+	// SIGUSR1 still gets a trace out of a menu that's been left open.
+	while(run) {
+		Trace::poll();
+		if(!graphics.wait_event(k_menu_wait_ms) || !SDL_PollEvent(&event)) {
+			continue;
+		}
 		// Proc event.
 		Hack::MenuResult result = menu_hack->event(&event);
 		switch(result) {
 			case Hack::MenuResult::CHANGE_HACK:
-				hack = change_hack(graphics, menu_hack->next_hack());
+				hacks.select(graphics, menu_hack->next_hack(),
+					hack_params(config, menu_hack->next_hack()));
 				cfg_setstr(config, "hack", menu_hack->next_hack().c_str());
-				save_config(config);
+				config_writer.save(config);
+				// Suspended hacks stay frozen; new ones have nothing to miss.
+				back_to_hack = false;
 				// fall through
 			case Hack::MenuResult::RETURN_TO_HACK:
 				run = false; break;
 			case Hack::MenuResult::SCREEN_OFF:
 				// Stay in the menu and wait for the tap to wake again.
 				backlight(false);
+				catch_up.start();
 				break;
 			case Hack::MenuResult::WAKE:
 				backlight(true);
@@ -185,6 +834,7 @@ void menu(SDL::Graphics& graphics, cfg_t* config,
 				break;
 			case Hack::MenuResult::QUIT:
 				run = false;
+				back_to_hack = false;
 				{
 					// Create a quit event to push into the main loop.
 					SDL_Event quit_event;
@@ -202,6 +852,7 @@ void menu(SDL::Graphics& graphics, cfg_t* config,
 		switch(event.type) {
 			case SDL_QUIT:
 				run = false;
+				back_to_hack = false;
 				// Reprocess this in the main() event loop to quit entirely.
 				SDL_PushEvent(&event);
 				break;
@@ -210,37 +861,312 @@ void menu(SDL::Graphics& graphics, cfg_t* config,
 		}
 		// Sim & render menu.
 		menu_hack->simulate();
+		render_hack(graphics, menu_hack);
+	}
+	if(back_to_hack) { catch_up.finish(); }
+}
+
+/* Headless, flat-out run of a representative workload, timing each hack: the
+ * clocks across an hour rollover (so snow builds up and drops out, and the
+ * particles explode), the rest for as long, and the menu being paged through.
+ * Time is faked, so it's the same every run. This is also what the PGO build
+ * trains on (see the Makefile). */
+constexpr int k_bench_seconds = 180; // Simulated, per hack.
+constexpr int k_bench_menu_visits = 100;
+
+void bench(SDL::Graphics& graphics, cfg_t* config) {
+	typedef std::chrono::steady_clock Clock;
+	auto us_since = [](Clock::time_point start) {
+		return std::chrono::duration_cast<std::chrono::microseconds>(
+			Clock::now() - start).count();
+	};
+
+	// Today, 90s before the top of the hour.
+	std::time_t start = std::time(nullptr);
+	std::tm start_tm;
+	localtime_r(&start, &start_tm);
+	start_tm.tm_min = 58;
+	start_tm.tm_sec = 30;
+	start = std::mktime(&start_tm);
+
+	std::cout << std::left << std::setw(18) << "hack/upload" << std::right
+		<< "  ticks  simulate us/tick  render us/tick" << std::endl;
+	auto report = [](const std::string& name, int ticks, Uint64 sim_us,
+		Uint64 render_us) {
+		std::cout << std::left << std::setw(18) << name << std::right
+			<< std::setw(7) << ticks
+			<< std::setw(18) << (ticks ? sim_us / ticks : 0)
+			<< std::setw(16) << (ticks ? render_us / ticks : 0) << std::endl;
+	};
+
+	// Each hack with each way of uploading frames, since which is cheaper
+	// depends on the hack as well as the renderer. The menu gets whichever
+	// was picked.
+	typedef SDL::Graphics::Upload Upload;
+	const Upload picked = graphics.upload;
+	std::vector<std::pair<Upload, const char*>> uploads;
+	if(picked == Upload::FBDEV) {
+		uploads.push_back({Upload::FBDEV, "fbdev"});
+	} else {
+		uploads.push_back({Upload::LOCK, "lock"});
+		uploads.push_back({Upload::UPDATE, "update"});
+	}
+	for(const auto& upload : uploads) {
+		graphics.upload = upload.first;
+		for(const char* name : kHackNames) {
+			std::unique_ptr<Hack::Base> hack = make_hack(graphics.w,
+				graphics.h, graphics.format, name, hack_params(config, name));
+			const Uint32 tick_ms = hack->tick_duration();
+			const int ticks = (k_bench_seconds * 1000) / tick_ms;
+			Uint64 sim_us = 0, render_us = 0;
+			for(int i = 0; i < ticks; ++i) {
+				WallClock::shared().tick(
+					start + ((static_cast<Uint64>(i) * tick_ms) / 1000));
+				Clock::time_point t = Clock::now();
+				hack->simulate();
+				sim_us += us_since(t);
+				t = Clock::now();
+				render_hack(graphics, hack.get());
+				render_us += us_since(t);
+			}
+			report(std::string(name) + "/" + upload.second, ticks, sim_us,
+				render_us);
+		}
+	}
+	graphics.upload = picked;
+
+	// Open it, go to the hack choice page, and back out, like a hesitant
+	// user. Taps are at the middles of the top-left and bottom-left buttons.
+	std::unique_ptr<Hack::Base> menu_hack =
+		Hack::MakeMenu(graphics.w, graphics.h, config);
+	auto tap = [&](int x, int y) {
+		SDL_Event event = {};
+		event.button.x = x;
+		event.button.y = y;
+		event.type = SDL_MOUSEBUTTONDOWN;
+		menu_hack->event(&event);
+		event.type = SDL_MOUSEBUTTONUP;
+		menu_hack->event(&event);
+		menu_hack->simulate();
+		render_hack(graphics, menu_hack.get());
+	};
+	Uint64 open_us = 0;
+	Clock::time_point t = Clock::now();
+	for(int i = 0; i < k_bench_menu_visits; ++i) {
+		// The tap that opens it goes through the event queue, as in main().
+		const Clock::time_point tapped = Clock::now();
+		SDL_Event event = {};
+		event.type = SDL_MOUSEBUTTONUP;
+		SDL_PushEvent(&event);
+		while(SDL_PollEvent(&event) && event.type != SDL_MOUSEBUTTONUP) {}
+		menu_hack->open_menu();
 		render_hack(graphics, menu_hack.get());
+		open_us += us_since(tapped);
+		tap(graphics.w / 4, graphics.h / 4); // Change display
+		tap(graphics.w / 4, (graphics.h * 3) / 4); // Cancel
 	}
+	// Counted as one tick per page shown.
+	report("menu", k_bench_menu_visits * 3, 0, us_since(t));
+	// From the tap to the first page shown.
+	report("menu open", k_bench_menu_visits, 0, open_us);
 }
 
+/* Runs one hack offscreen, from a fixed date and time, a frame per tick, and
+ * dumps every frame (see FrameDump), for comparing one build's output with
+ * another's. The hacks' generators are all default-seeded, and snapshots are
+ * off, so given the same config the same frames come out every time. */
+void dump(SDL::Graphics& graphics, cfg_t* config, const std::string& name,
+	const std::string& path, int seconds) {
+
+	// Across midnight on Christmas Eve, so every digit changes.
+	std::tm start_tm = {};
+	start_tm.tm_year = 2023 - 1900;
+	start_tm.tm_mon = 11;
+	start_tm.tm_mday = 24;
+	start_tm.tm_hour = 23;
+	start_tm.tm_min = 58;
+	start_tm.tm_sec = 30;
+	start_tm.tm_isdst = -1;
+	const std::time_t start = std::mktime(&start_tm);
+	WallClock::shared().tick(start);
+
+	std::unique_ptr<Hack::Base> hack = make_hack(graphics.w, graphics.h,
+		graphics.format, name, hack_params(config, name));
+	const Uint32 tick_ms = hack->tick_duration();
+	FrameDump frames(path, graphics.w, graphics.h, graphics.format, tick_ms);
+	graphics.dump = &frames;
+	const int ticks = (seconds * 1000) / tick_ms;
+	for(int i = 0; i < ticks; ++i) {
+		WallClock::shared().tick(
+			start + ((static_cast<Uint64>(i) * tick_ms) / 1000));
+		hack->simulate();
+		if(hack->want_render()) {
+			render_hack(graphics, hack.get());
+		} else {
+			frames.repeat(); // Keep the stream one frame per tick.
+		}
+	}
+	graphics.dump = nullptr;
+}
+
+/* Stands in for a user when running offscreen (--offscreen), so the real
+ * main loop, menu and hack switching get exercised end to end: every few
+ * seconds it taps to open the menu and picks the other clock, and after a
+ * number of rounds, quits. Taps are pushed from its own thread, as the menu
+ * blocks the main one waiting for them. */
+constexpr Uint32 k_tour_step_ms = 2000;
+constexpr int k_tour_rounds = 10;
+
+class Tour {
+	int w_, h_;
+	std::mutex mutex_;
+	std::condition_variable wake_;
+	bool quit_;
+	std::thread thread_;
+
+	// Like a finger, with no motion between.
+	void tap(int x, int y) {
+		SDL_Event event = {};
+		event.button.x = x;
+		event.button.y = y;
+		event.type = SDL_MOUSEBUTTONDOWN;
+		SDL_PushEvent(&event);
+		event.type = SDL_MOUSEBUTTONUP;
+		SDL_PushEvent(&event);
+	}
+
+	// False if told to stop meanwhile.
+	bool wait(Uint32 ms) {
+		std::unique_lock<std::mutex> lock(mutex_);
+		return !wake_.wait_for(lock, std::chrono::milliseconds(ms),
+			[&]{ return quit_; });
+	}
+
+	void run() {
+		for(int round = 0; round < k_tour_rounds; ++round) {
+			if(!wait(k_tour_step_ms)) { return; }
+			tap(w_ / 2, h_ / 2); // Open the menu.
+			if(!wait(k_tour_step_ms / 4)) { return; }
+			tap(w_ / 4, h_ / 4); // Change display
+			if(!wait(k_tour_step_ms / 4)) { return; }
+			// Snow or Pop, in turn.
+			tap(round % 2 ? w_ / 4 : (w_ * 3) / 4, h_ / 4);
+		}
+		if(!wait(k_tour_step_ms)) { return; }
+		SDL_Event quit_event = {};
+		quit_event.type = SDL_QUIT;
+		SDL_PushEvent(&quit_event);
+	}
+
+public:
+	Tour(int w, int h) : w_(w), h_(h), quit_(false) {
+		thread_ = std::thread(&Tour::run, this);
+	}
+
+	~Tour() {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			quit_ = true;
+		}
+		wake_.notify_one();
+		thread_.join();
+	}
+};
+
 int main(int argc, char** argv) {
-	SDL::Graphics graphics;
+	Trace::install();
+	const bool benchmark = argc > 1 && std::string(argv[1]) == "--bench";
+	const bool tour = argc > 1 && std::string(argv[1]) == "--offscreen";
+	const bool dumping = argc > 1 && std::string(argv[1]) == "--dump";
+	if(dumping && argc < 4) {
+		std::cerr << "Usage: " << argv[0] << " --dump HACK (OUT.y4m|PREFIX)"
+			" [SECONDS]" << std::endl;
+		return EXIT_FAILURE;
+	}
+	if(benchmark) {
+		// No window needed, unless asked for one.
+		setenv("SDL_VIDEODRIVER", "dummy", 0);
+	}
+	if(benchmark || tour || dumping) {
+		// Leave the real clock's snow be.
+		Snapshot::disable_files();
+	}
+
+	ConfigSchema config_schema;
+	cfg_t* config = cfg_init(config_schema.options.data(), CFGF_NONE);
+	// This apparently will print on failure all by itself.
+	cfg_parse(config, kConfigFile);
+	ConfigWriter config_writer(tour || dumping ? nullptr : kConfigFile);
+
+	// Dumping has no use for timing uploads to pick one.
+	SDL::Graphics graphics(
+		tour || dumping ? "offscreen" : cfg_getstr(config, "backend"),
+		cfg_getstr(config, "fbdev"), dumping ? "update" : cfg_getstr(config, "upload"),
+		cfg_getint(config, "pixel_scale"));
 #ifndef DESKTOP
 	SDL_ShowCursor(0);
 #endif
-	SDL_SetRenderDrawColor(graphics.renderer, 0x77, 0x77, 0x77, 0xff);
-	SDL_RenderClear(graphics.renderer);
-	SDL_RenderPresent(graphics.renderer);
-
-	cfg_opt_t config_options[] =
-	{
-		CFG_STR("hack", "snowclock", CFGF_NONE),
-		CFG_END()
-	};
-	cfg_t* config = cfg_init(config_options, CFGF_NONE);
-	// This apparently will print on failure all by itself.
-	cfg_parse(config, kConfigFile);
+	if(graphics.renderer) {
+		// Also what's left around the edges when letterboxed.
+		SDL_SetRenderDrawColor(graphics.renderer, 0x77, 0x77, 0x77, 0xff);
+	}
+	SDL_FillRect(graphics.begin_frame(), nullptr,
+		SDL_MapRGB(graphics.format, 0x77, 0x77, 0x77));
+	graphics.end_frame();
+	graphics.present();
 
-	std::unique_ptr<Hack::Base> hack =
-		change_hack(graphics, cfg_getstr(config, "hack"));
+	if(benchmark) {
+		bench(graphics, config);
+		Stats::report(std::cerr);
+		Trace::dump();
+		cfg_free(config);
+		return EXIT_SUCCESS;
+	}
+	if(dumping) {
+		dump(graphics, config, argv[2], argv[3],
+			argc > 4 ? std::atoi(argv[4]) : k_bench_seconds);
+		cfg_free(config);
+		return EXIT_SUCCESS;
+	}
+
+	// SDL's dummy driver, which fbdev runs under, gets no input of its own.
+	std::unique_ptr<Touch> touch;
+	if(graphics.framebuffer) {
+		try {
+			touch.reset(new Touch(cfg_getstr(config, "touch"), graphics.w,
+				graphics.h));
+		} catch(const std::runtime_error& e) {
+			std::cerr << e.what() << "; the menu can't be opened" << std::endl;
+		}
+	}
+
+	HackSwitcher hacks(graphics, cfg_getstr(config, "hack"),
+		hack_params(config, cfg_getstr(config, "hack")));
+	// Built up-front so the first tap doesn't wait on loading the font.
+	std::unique_ptr<Hack::Base> menu_hack =
+		Hack::MakeMenu(graphics.w, graphics.h, config);
+
+	Overlay overlay;
+	bool show_overlay = cfg_getbool(config, "overlay");
+
+	std::unique_ptr<Tour> touring;
+	if(tour) {
+		// What it's for is the timings at the end.
+		Stats::enable();
+		touring.reset(new Tour(graphics.w, graphics.h));
+	}
 
 	Uint32 tickerror = 0;
 	Uint32 ticklast = SDL_GetTicks();
 	SDL_Event event;
 	bool run = true;
 	while(run) {
+		Trace::poll();
 		// Process events.
+		// Not a Trace::Span, which would take in the menu too. Checked
+		// first, as reading the clock every loop isn't free.
+		const bool tracing = Trace::enabled();
+		const std::uint64_t events_begin_us = tracing ? Trace::now_us() : 0;
 		while(SDL_PollEvent(&event)) { switch(event.type) {
 			case SDL_QUIT:
 				run = false; break;
@@ -249,17 +1175,33 @@ int main(int argc, char** argv) {
 					case SDLK_ESCAPE:
 					case SDLK_q:
 						 run = false; break;
+					case SDLK_o:
+						show_overlay = !show_overlay;
+						// Paint over it, or paint it, even if idle.
+						hacks.hack()->resume();
+						break;
 					default:; // Don't care.
 				}
 				break;
 			case SDL_MOUSEBUTTONUP:
 				// Go to the menu.
-				menu(graphics, config, hack);
-				// Skip sim time forward so we don't try to catch up.
+				menu(graphics, config, config_writer, hacks,
+					menu_hack.get(), event.button.timestamp);
+				// The menu drew over us.
+				hacks.hack()->resume();
+				// The menu caught the hack up on the time it was away, or as
+				// much as it could; don't run those ticks again.
 				ticklast = SDL_GetTicks();
 				break;
 			default:; // Don't care.
 		}}
+		if(tracing) {
+			Trace::record("events", events_begin_us, Trace::now_us());
+		}
+
+		// Pick up a newly-chosen hack once it's ready.
+		hacks.poll();
+		Hack::Base* hack = hacks.hack();
 
 		// Process the passage of time.
 		{
@@ -283,16 +1225,39 @@ int main(int argc, char** argv) {
 			}
 			do {
 				tickerror -= hack->tick_duration();
+				WallClock::shared().tick();
+				Stats::Scope timing(Stats::Phase::SIMULATE);
+				Trace::Span span("simulate");
 				hack->simulate();
 			} while(tickerror >= hack->tick_duration());
 
-			render_hack(graphics, hack.get());
+			render_hack(graphics, hack, show_overlay ? &overlay : nullptr,
+				double(tickerror) / hack->tick_duration());
+		} else if(Uint32 idle = hack->idle_duration()) {
+			// Nothing will visibly change for a while, so block until then
+			// (or until there's input) rather than waking every tick.
+			graphics.wait_event(idle);
+			// Then run just the one tick; there was nothing to catch up on.
+			ticklast = SDL_GetTicks();
+			tickerror = hack->tick_duration();
+		} else if(hack->interpolates()) {
+			// Draw the way there, then nap for a frame, or until the tick.
+			render_hack(graphics, hack, show_overlay ? &overlay : nullptr,
+				double(tickerror) / hack->tick_duration());
+			SDL_Delay(std::min(k_interpolated_frame_ms,
+				hack->tick_duration() - tickerror));
 		} else {
 			/// Have a nap until we actually have at least one tick to run.
 			SDL_Delay(hack->tick_duration());
 		}
 	}
 
+	Stats::report(std::cerr);
+	if(Stats::enabled() && graphics.framebuffer) {
+		graphics.framebuffer->report(std::cerr);
+	}
+	Trace::dump();
+	menu_hack.reset();
 	cfg_free(config);
 	return EXIT_SUCCESS;
 }
@@ -16,31 +16,61 @@
 
 #include "hack.hpp"
 #include "digitalclock.hpp"
+#include "margolus.hpp"
+#include "snapshot.hpp"
+#include "trace.hpp"
+#include "wallclock.hpp"
 
-constexpr size_t k_defragment_threshold = 128; // Don't defrag to < this.
 constexpr int k_defragment_factor = 2; // N times size vs number active.
-constexpr double k_segment_drip_chance = 0.075;
-constexpr bool k_digits_drip = false;
 constexpr bool k_digits_pop = true;
 constexpr bool k_explode_on_hour = true;
 constexpr bool k_debug_fastclock = false;
+constexpr Uint32 k_snapshot_version = 2; // 2: palette indices, not ARGB
+const Hack::Param k_param_tick_duration = // ms
+	{"tick_duration", Hack::Param::Type::INT, 33, 1, 10000}; // 30Hz
+const Hack::Param k_param_defragment_threshold = // Don't defrag to < this.
+	{"defragment_threshold", Hack::Param::Type::INT, 128, 0, 1 << 20};
+const Hack::Param k_param_digits_drip =
+	{"digits_drip", Hack::Param::Type::BOOL, false, 0, 1};
+const Hack::Param k_param_segment_drip_chance =
+	{"segment_drip_chance", Hack::Param::Type::FLOAT, 0.075, 0, 1};
+// Draw particles between ticks; see Hack::Base::interpolates().
+const Hack::Param k_param_interpolate =
+	{"interpolate", Hack::Param::Type::BOOL, false, 0, 1};
 
 namespace Hack {
 struct PopClock : public Hack::Base {
 	int w, h;
 	// Build up the particles for buffering, and also we want
 	// to write raw in a known pixel format rather than FillRect.
+	// 8-bit, indexing the palette below; the blit expands it to color.
 	std::unique_ptr<SDL_Surface, decltype(&SDL_FreeSurface)> partfb;
+	/* Particles all take the clock's color when they pop, and the clock's
+	 * colors all come from hue_to_rgb(), so a particle only needs to know
+	 * which hue it is. Index 0 is empty (black); the rest are hues quantized
+	 * evenly around the wheel. */
+	static constexpr int k_palette_size = 256;
 	std::default_random_engine generator;
 	std::uniform_int_distribution<int> random_coinflip;
 	std::uniform_real_distribution<double> random_frac;
 	bool needs_paint; // Something has changed to render.
+	bool idle; // Last tick changed nothing; only the clock can wake us.
+	// The hour as of our last tick, rather than asking WallClock whether it
+	// just changed, since we may have been suspended across the change.
+	int last_hour;
+	bool previous_segments[4][7]; // What the digits showed last time.
+	Uint32 tick_duration_;
+	size_t defragment_threshold;
+	bool digits_drip;
+	double segment_drip_chance;
+	bool interpolate;
 
 	struct Particle {
 		bool active;
 		double x, y, dx, dy; // dx/dy should not exceed one.
+		double previous_x, previous_y; // As of the tick before.
 		double tv; // terminal velocity can be *less* than one.
-		Uint32 color; // Same format as partfb, i.e. ARGB.
+		Uint8 color; // Palette index, as partfb.
 
 		static constexpr double k_gravity = 0.01;
 		static constexpr double k_friction = 0.8;
@@ -50,10 +80,12 @@ struct PopClock : public Hack::Base {
 		Particle() : active(false) {}
 
 		// Explode alive with random movement.
-		void pop(PopClock& h, double x, double y, Uint32 c) {
+		void pop(PopClock& h, double x, double y, Uint8 c) {
 			active = true;
 			this->x = x;
 			this->y = y;
+			previous_x = x;
+			previous_y = y;
 			tv = (h.random_frac(h.generator) * 0.7) + 0.3;
 			dx = (h.random_frac(h.generator) * tv);
 			if(h.random_coinflip(h.generator)) { dx *= -1.0; }
@@ -71,6 +103,8 @@ struct PopClock : public Hack::Base {
 		// static layer.
 		bool simulate(std::function<bool(int,int)> obstacles) {
 			assert(active);
+			previous_x = x;
+			previous_y = y;
 
 			// Work out potential new location (prime).
 			double xp = x + dx;
@@ -112,6 +146,7 @@ struct PopClock : public Hack::Base {
 	};
 	std::vector<Particle> particles;
 	bool have_live_particles;
+	size_t live_particles; // As of the last simulate(), for the overlay.
 
 	/* Get an index for the next free (inactive) particle in the particles
 	 * vector. In past versions this did clever circular buffer stuff with
@@ -124,6 +159,7 @@ struct PopClock : public Hack::Base {
 	}
 
 	void defragment_particles() {
+		Trace::Span span("defragment particles");
 		// Note this doesn't touch the allocation; that's up to vector, and
 		// since we're not hurting for memory there's not much reason to be
 		// reallocating. We're reducing the logical size so we can iterate over
@@ -136,15 +172,20 @@ struct PopClock : public Hack::Base {
 	}
 
 	class StaticParticles {
-		std::vector<Uint32> color_; // partfb format, i.e. ARGB; 0 = empty.
+		// Kept in a snapshot file so a restart doesn't lose the accumulation.
+		Snapshot snapshot_;
+		Uint8* color_; // Palette index, as partfb; 0 = empty.
 		int w_, h_;
 		// Y co-ordinate of higest particle needing simulation (h = none).
 		int needs_sim_up_to;
+		// What needs_sim_up_to was for the previous pass.
+		int previous_request;
+		Margolus<Uint8> engine_;
 
 		// Convert to a dynamic particle, if there is one free, and clear the
 		// static mass here if so.
 		// Returns the index of the new particle (or -1 if failed).
-		int try_pop(PopClock& h, int x, int y, Uint32 here, bool down=true) {
+		int try_pop(PopClock& h, int x, int y, Uint8 here, bool down=true) {
 			size_t i = h.find_free_particle();
 			h.particles[i].pop(h, x, y, here);
 			// Force downward momentum.
@@ -154,76 +195,62 @@ struct PopClock : public Hack::Base {
 		}
 
 		// This is mostly split out for profiling reasons (when not inline).
-		// If it's being called, "here" is nonzero.
+		// If it's being called, top[x] is nonzero. bottom is nullptr on the
+		// bottom row of the grid, in which case drop_bottom must be set.
 		// Returns if it did anything
-		inline bool simulate_one(PopClock& h,
-			std::function<bool(int,int)> obstacles, bool drop_bottom,
-			int x, int y, Uint32 here) {
+		inline bool simulate_one(PopClock& h, bool drop_bottom, int x, int y,
+			int offset, Uint8* top, Uint8* bottom,
+			const Uint8* solid_top, const Uint8* solid_bottom) {
+			Uint8 here = top[x];
 			// Hit check; get crushed by obstacles
-			if(obstacles(x, y)) { set(x, y, 0); return true; }
+			if(solid_top[x]) { set(x, y, 0); return true; }
 
 			// Fall check
-			bool fall = false;
-			if(y+1 >= h_) {
-				if(drop_bottom) { fall = true; }
-			} else {
-				Uint32 down = get(x, y+1);
-				if((down == 0) && !obstacles(x, y+1)) { fall = true; }
-			}
-			if(fall) {
+			if(bottom == nullptr || (bottom[x] == 0 && !solid_bottom[x])) {
+				assert(bottom != nullptr || drop_bottom);
 				int i = try_pop(h, x, y, here);
 				// Damped horizontal movement.
 				h.particles[i].dx *= 0.25;
 				return true;
 			}
-			// We shouldn't be simming the bottom row beyond this point!
-			// That would mean we got run on it without drop_bottom set, which
-			// would be, at best, pointless. But also means we're confused.
-			// (And we will throw on the assert in obstacles() checks below.)
-			assert(y+1 < h_);
-
-			// Angle of repose check
-			// FIXME The left->right sweep means we spill left-biased anyway
-			Uint32 down_left = get(x-1, y+1);
-			bool down_left_obstacle = x==0 ? true : obstacles(x-1, y+1);
-			Uint32 down_right = get(x+1, y+1);
-			bool down_right_obstacle = x==w_-1 ? true : obstacles(x+1, y+1);
-			if(down_left == 0 && ! down_left_obstacle) {
-				if(down_right == 0 && !down_right_obstacle) {
-					// Split, 3-way flow. Go either way!
-					try_pop(h, x, y, here);
-					return true;
-				} else {
-					// Spill left
-					int i = try_pop(h, x, y, here);
-					h.particles[i].dx = -abs(h.particles[i].dx);
-				}
-				return true;
-			} else if (down_right == 0 &&
-				!down_right_obstacle) {
-				// Spill right
+
+			// Angle of repose check; spill towards the other column of the
+			// block, if there is one. Popping only clears top cells, and we
+			// only look at bottom cells, so the block order doesn't matter.
+			int p = engine_.partner(x, offset);
+			if(p >= 0 && bottom[p] == 0 && !solid_bottom[p]) {
 				int i = try_pop(h, x, y, here);
-				h.particles[i].dx = abs(h.particles[i].dx);
+				h.particles[i].dx = (p > x) ?
+					abs(h.particles[i].dx) : -abs(h.particles[i].dx);
 				return true;
 			}
 			return false;
 		}
 
-		inline Uint32& unsafe_at(int x, int y) {
+		inline Uint8& unsafe_at(int x, int y) {
 			return color_[x + (y*w_)];
 		}
 
 	public:
-		StaticParticles(int w, int h) : w_(w), h_(h), needs_sim_up_to(h) {
-			color_.resize(w_ * h_);
+		StaticParticles(int w, int h) :
+			snapshot_("popclock", k_snapshot_version, w, h, sizeof(Uint8)),
+			color_(snapshot_.cells<Uint8>()), w_(w), h_(h),
+			// Anything restored may need to settle against the current time.
+			needs_sim_up_to(snapshot_.restored() ? 0 : h),
+			previous_request(h), engine_(w, h) {}
+
+		void sync() { snapshot_.sync(); }
+
+		void copy_row(int y, Uint8* out) {
+			std::copy(color_ + (y*w_), color_ + ((y+1)*w_), out);
 		}
 
-		Uint32 get(int x, int y) {
+		Uint8 get(int x, int y) {
 			if(x < 0 || x >= w_ || y < 0 || y >= h_) { return 0; }
 			return unsafe_at(x, y);
 		}
 
-		void set(int x, int y, Uint32 c) {
+		void set(int x, int y, Uint8 c) {
 			if(x < 0 || x >= w_ || y < 0 || y >= h_) { return; }
 			unsafe_at(x, y) = c;
 			// Allow for the one above us to fall.
@@ -231,38 +258,52 @@ struct PopClock : public Hack::Base {
 		}
 
 		bool simulate(PopClock& h, bool drop_bottom,
-			std::function<bool(int,int)> obstacles) {
+			DigitalClock& obstacles) {
+			Trace::Span span("static particles");
 			bool done_something = false;
-			// The bottom row is usually completely static once formed, but
-			// when drop_bottom is true, we let it fall away.
-			int start_y = h_ - (drop_bottom ? 1 : 2);
-			// Only sim up to changes; if drop-bottom, that forces bottom row.
-			// (If not drop-bottom, if nothing else active, don't loop at all.)
-			int stop_y = std::min(needs_sim_up_to, drop_bottom ? h_ - 1 : h_);
+			// Only sim up to changes. A row only gets a go at falling on
+			// alternate passes, so each request is honoured for two.
+			// If drop-bottom, that forces bottom row.
+			int requested = needs_sim_up_to;
+			int stop_y = std::min(requested, previous_request);
+			previous_request = requested;
 			needs_sim_up_to = h_;
-			// We continue once *something* has happened to the mass here, so it
-			// only gets one change per tick.
-			// Bottom-up makes falling natural.
-			for(int y = start_y; y >= stop_y; --y) {
+			if(drop_bottom) { stop_y = std::min(stop_y, h_ - 1); }
+			// (If not drop-bottom, if nothing else active, don't loop at all.)
+			if(stop_y >= h_) { engine_.skip(); return false; }
+			engine_.pass(color_, stop_y,
+				[&](Uint8* top, Uint8* bottom, int y, int offset) {
+				// The bottom row is usually completely static once formed,
+				// but when drop_bottom is true, we let it fall away.
+				if(bottom == nullptr && !drop_bottom) { return; }
+				const Uint8* solid_top = obstacles.solid_row(y);
+				const Uint8* solid_bottom =
+					bottom ? obstacles.solid_row(y+1) : nullptr;
 				for(int x = 0; x < w_; ++x) {
-					Uint32 here = unsafe_at(x, y); // We're iterating in-bounds
-					if(here > 0) {
-						done_something |=
-							simulate_one(h, obstacles, drop_bottom, x, y, here);
+					if(top[x] > 0) {
+						done_something |= simulate_one(h, drop_bottom, x, y,
+							offset, top, bottom, solid_top, solid_bottom);
 					}
 				}
-			}
+			});
 			return done_something;
 		}
 
+		// True if the next pass has anything to look at, even if this one
+		// didn't move anything.
+		bool settling() const {
+			return needs_sim_up_to < h_ || previous_request < h_;
+		}
+
 		void force_full_simulate_next(int up_to) {
 			needs_sim_up_to = up_to;
 		}
 
 		void pop_all(PopClock& h) {
+			Trace::Span span("pop all");
 			for(int y = 0; y < h_; ++y) {
 				for(int x = 0; x < w_; ++x) {
-					Uint32 here = unsafe_at(x, y); // We're iterating in-bounds
+					Uint8 here = unsafe_at(x, y); // We're iterating in-bounds
 					if(here > 0) {
 						try_pop(h, x, y, here, false);
 					}
@@ -270,39 +311,61 @@ struct PopClock : public Hack::Base {
 			}
 			// Cancel all sim; we've just wiped all static particles away.
 			needs_sim_up_to = h_;
+			previous_request = h_;
 		}
 	};
 	StaticParticles static_particles;
 	DigitalClock digital_clock;
 
-	PopClock(int w, int h)
+	PopClock(int w, int h, const Params& params)
 		: w(w), h(h),
 		partfb(nullptr, SDL_FreeSurface),
 		random_coinflip(0, 1),
 		random_frac(0, 1),
 		needs_paint(true),
+		idle(false),
+		last_hour(-1),
+		tick_duration_(params.get_int(k_param_tick_duration)),
+		defragment_threshold(params.get_int(k_param_defragment_threshold)),
+		digits_drip(params.get_bool(k_param_digits_drip)),
+		segment_drip_chance(params.get(k_param_segment_drip_chance)),
+		interpolate(params.get_bool(k_param_interpolate)),
 		have_live_particles(false),
+		live_particles(0),
 		static_particles(w, h),
 		digital_clock(w, h, true) {
 
 		/* Making SDL format-convert means we don't have to at write time, and
-		 * can just slap down 32-bit values. */
+		 * can just slap down palette indices, straight from the static grid. */
 		partfb.reset(SDL_CreateRGBSurface(SDL_SWSURFACE | SDL_ASYNCBLIT,
-			w, h, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0));
+			w, h, 8, 0, 0, 0, 0));
 		if(partfb.get() == nullptr) {
 			throw std::bad_alloc();
 		}
+		SDL_Color pal[k_palette_size] = {};
+		for(int i = 1; i < k_palette_size; ++i) {
+			digital_clock.hue_to_rgb(double(i - 1) / (k_palette_size - 1),
+				pal[i].r, pal[i].g, pal[i].b);
+		}
+		if(SDL_SetColors(partfb.get(), pal, 0, k_palette_size) != 1) {
+			throw std::runtime_error("failed to set particle palette");
+		}
 
 		for(auto&& particle : particles) {
 			particle.stop();
 		}
+		for(int d = 0; d < 4; ++d) {
+			for(int segment = 0; segment < 7; ++segment) {
+				previous_segments[d][segment] = false;
+			}
+		}
 	}
 
 	void simulate() override {
-		static int last_second;
 		// Get localtime and set the clock.
-		std::time_t now_epoch = std::time(nullptr);
-		std::tm* now = std::localtime(&now_epoch);
+		const WallClock& wall_clock = WallClock::shared();
+		std::tm now_tm = *wall_clock.now();
+		std::tm* now = &now_tm;
 		if(k_debug_fastclock) {
 			now->tm_hour = now->tm_min % 24;
 			now->tm_min = now->tm_sec;
@@ -315,36 +378,34 @@ struct PopClock : public Hack::Base {
 				digital_clock.get_digit(0).segrect[0].y - 1);
 			needs_paint = true;
 		}
-		if(last_second != now->tm_sec) {
+		if(wall_clock.second_changed()) {
 			// Bit of an info leak that we know the clock makes quiet visual
 			// changes every second (its palette), but not shape changes.
 			needs_paint = true;
-			last_second = now->tm_sec;
 		}
 
 		// Drop out on the hour for 15 seconds.
 		bool dropout = now->tm_min == 0 && now->tm_sec < 15;
 
-		if(k_explode_on_hour) {
-			static int last_hour = -1;
-			if(last_hour != now->tm_hour) {
-				static_particles.pop_all(*this);
-				last_hour = now->tm_hour;
-			}
+		// (Not on the first tick, which would blow away a restored snapshot.)
+		if(k_explode_on_hour && last_hour != -1 &&
+			last_hour != now->tm_hour) {
+			static_particles.pop_all(*this);
 		}
+		last_hour = now->tm_hour;
+		// Write the particles back to the snapshot once a minute.
+		if(wall_clock.minute_changed()) { static_particles.sync(); }
 
 		// Perhaps spawn some particles dripping/launching off of segments.
-		SDL_Color& color_struct =
-			digital_clock.rendered()->format->palette->colors[1];
-		Uint32 color = SDL_MapRGB(partfb.get()->format,
-			color_struct.r, color_struct.g, color_struct.b);
+		Uint8 color = 1 + std::min(k_palette_size - 2,
+			int(digital_clock.hue() * (k_palette_size - 1)));
 		for(int d = 0; d < 4; ++d) {
 			auto digit = digital_clock.get_digit(d);
 			for(int segment = 0; segment < 7; ++segment) {
 				bool present = digit.segment[segment];
 				// Drip from existing segments.
-				if(k_digits_drip && present &&
-					random_frac(generator) < k_segment_drip_chance) {
+				if(digits_drip && present &&
+					random_frac(generator) < segment_drip_chance) {
 
 					bool drip = random_coinflip(generator);
 					int x = digit.segrect[segment].x;
@@ -366,7 +427,6 @@ struct PopClock : public Hack::Base {
 				}
 				// Pop from freshly missing segments.
 				if(k_digits_pop && clock_changed) {
-					static bool previous_segments[4][7];
 					if(!present && previous_segments[d][segment]) {
 						// This segment just vanished; pop it.
 						Sint16 x = digit.segrect[segment].x;
@@ -387,6 +447,7 @@ struct PopClock : public Hack::Base {
 
 		// Simulate particles.
 		size_t active_particles = 0;
+		const bool had_live_particles = have_live_particles;
 		if(have_live_particles) {
 			for(auto&& particle : particles) {
 				if(!particle.active) { continue; }
@@ -423,7 +484,7 @@ struct PopClock : public Hack::Base {
 
 			// Defragment particles if it's getting sparse.
 			// (Don't bother if it's *empty*.)
-			if((particles.size() > k_defragment_threshold) &&
+			if((particles.size() > defragment_threshold) &&
 				((active_particles * k_defragment_factor) < particles.size())) {
 				defragment_particles();
 			}
@@ -432,36 +493,81 @@ struct PopClock : public Hack::Base {
 			needs_paint = true;
 		}
 
+		live_particles = active_particles;
+
 		// Simulate the static particle mass.
-		needs_paint |= static_particles.simulate(*this, dropout,
-			[&](auto x, auto y){return digital_clock.solid_at(x, y);});
+		bool static_changed = static_particles.simulate(*this, dropout,
+			digital_clock);
+		needs_paint |= static_changed;
+
+		// If nothing moved, nothing will until the clock next changes, which
+		// can only happen on a second boundary. (Dripping is random, though.)
+		idle = !digits_drip && !clock_changed && !had_live_particles &&
+			!have_live_particles && !static_changed &&
+			!static_particles.settling();
+	}
+
+	Uint32 fast_forward(Uint32 ticks,
+		const std::function<bool()>& step) override {
+		Uint32 run = 0;
+		for(; run < ticks && step(); ++run) {
+			// Idle ticks change nothing until the next second; overnight,
+			// that's most of them.
+			if(idle && !WallClock::shared().second_changed()) { continue; }
+			simulate();
+		}
+		return run;
+	}
+
+	// Moving particles look different every frame, when drawn in between.
+	bool want_render() override {
+		return needs_paint || (interpolate && have_live_particles);
 	}
 
-	bool want_render() override { return needs_paint; }
+	bool interpolates() override { return interpolate; }
+
+	void resume() override {
+		// Whatever drew over us needs painting over, even if we're idle.
+		needs_paint = true;
+		idle = false;
+	}
+
+	size_t memory_footprint() override {
+		return (w * h * 3) // static, partfb, clock; a byte each
+			+ (particles.capacity() * sizeof(Particle));
+	}
 
-	void render(SDL_Surface* fb) override {
+	Uint32 idle_duration() override {
+		if(!idle) { return 0; }
+		// Sleep until just past the next second boundary of the wall clock.
+		return WallClock::shared().until_next_second() + 1;
+	}
+
+	void render(SDL_Surface* fb) override { render_between(fb, 1.0); }
+
+	void render_between(SDL_Surface* fb, double alpha) override {
 		if(SDL_MUSTLOCK(partfb.get())) { SDL_LockSurface(partfb.get()); }
-		SDL_FillRect(partfb.get(), nullptr, 0);
 		Uint8* pfb_pixels = reinterpret_cast<Uint8*>(partfb.get()->pixels);
-		auto bytes_per_pixel = partfb->format->BytesPerPixel;
 		auto pitch = partfb->pitch;
 		auto pixel_at = [&](Sint16 x, Sint16 y){
-			return reinterpret_cast<Uint32*>(
-				pfb_pixels + (x*bytes_per_pixel) + (y*pitch));
+			return pfb_pixels + x + (y*pitch);
 		};
 
+		// Same format, so the static layer is just a copy (and overwrites
+		// the whole thing, so no need to clear it first).
 		for(Sint16 y=0; y<h; ++y) {
-			for(Sint16 x=0; x<w; ++x) {
-				Uint32 c = static_particles.get(x, y);
-				if(c != 0) {
-					*pixel_at(x, y) = c;
-				}
-			}
+			static_particles.copy_row(y, pixel_at(0, y));
 		}
 
+		// In between, still truncated to a pixel the same way; somewhere
+		// between two in-bounds positions is in bounds too.
+		const double from = interpolate ? 1.0 - alpha : 0.0;
 		for(auto&& particle : particles) {
 			if(!particle.active) { continue; }
-			*pixel_at(particle.x, particle.y) = particle.color;
+			*pixel_at(
+				particle.x + ((particle.previous_x - particle.x) * from),
+				particle.y + ((particle.previous_y - particle.y) * from))
+				= particle.color;
 		}
 
 		if(SDL_MUSTLOCK(partfb.get())) { SDL_UnlockSurface(partfb.get()); }
@@ -472,11 +578,24 @@ struct PopClock : public Hack::Base {
 		needs_paint = false;
 	}
 
-	Uint32 tick_duration() override { return 33; } // 30Hz
+	void counters(Counters& out) override {
+		out.push_back({"live particles", static_cast<long>(live_particles)});
+		out.push_back({"particles", static_cast<long>(particles.size())});
+		out.push_back({"capacity", static_cast<long>(particles.capacity())});
+	}
+
+	Uint32 tick_duration() override { return tick_duration_; }
 };
 
-std::unique_ptr<Hack::Base> MakePopClock(int w, int h) {
-	return std::make_unique<PopClock>(w, h);
+std::unique_ptr<Hack::Base> MakePopClock(int w, int h, const Params& params) {
+	return std::make_unique<PopClock>(w, h, params);
+}
+
+const ParamSchema& PopClockParams() {
+	static const ParamSchema schema = {k_param_tick_duration,
+		k_param_defragment_threshold, k_param_digits_drip,
+		k_param_segment_drip_chance, k_param_interpolate};
+	return schema;
 }
 
 }; // namespace Hack
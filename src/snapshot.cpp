@@ -0,0 +1,131 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
+
+constexpr const char* k_snapshot_dir = "/var/tmp";
+constexpr char k_snapshot_magic[8] = {'P', 'I', 'X', 'S', 'N', 'A', 'P', 0};
+static bool files_enabled = true;
+
+namespace {
+	// Padded out so the cells start nicely aligned.
+	struct Header {
+		char magic[8];
+		std::uint32_t version;
+		std::uint32_t w, h;
+		std::uint32_t cell_size;
+		unsigned char padding[40];
+	};
+	static_assert(sizeof(Header) == 64, "snapshot header should be 64 bytes");
+};
+
+Snapshot::Snapshot(const char* name, std::uint32_t version, int w, int h,
+	std::size_t cell_size) :
+	fd_(-1), map_(MAP_FAILED), map_size_(0), cells_(nullptr), restored_(false) {
+
+	std::string path =
+		std::string(k_snapshot_dir) + "/pixmas-" + name + ".snap";
+	if(!files_enabled || !map_file(path.c_str(), version, w, h, cell_size)) {
+		fallback_.resize(w * h * cell_size);
+		cells_ = fallback_.data();
+	}
+}
+
+bool Snapshot::map_file(const char* path, std::uint32_t version, int w, int h,
+	std::size_t cell_size) {
+
+	const std::size_t size = sizeof(Header) + (w * h * cell_size);
+	int fd = open(path, O_RDWR | O_CREAT, 0644);
+	if(fd == -1) {
+		std::cerr << "Can't open snapshot '" << path << "': "
+			<< strerror(errno) << std::endl;
+		return false;
+	}
+	struct stat st;
+	bool fresh = (fstat(fd, &st) != 0) ||
+		(static_cast<std::size_t>(st.st_size) != size);
+	if(fresh) {
+		// Truncating to nothing first zeroes anything already there.
+		if(ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0) {
+			std::cerr << "Can't size snapshot '" << path << "': "
+				<< strerror(errno) << std::endl;
+			close(fd);
+			return false;
+		}
+	}
+	// Private, so changes stay in memory until written back by sync().
+	map_ = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if(map_ == MAP_FAILED) {
+		std::cerr << "Can't map snapshot '" << path << "': "
+			<< strerror(errno) << std::endl;
+		close(fd);
+		return false;
+	}
+	fd_ = fd;
+	map_size_ = size;
+
+	Header* header = static_cast<Header*>(map_);
+	cells_ = static_cast<unsigned char*>(map_) + sizeof(Header);
+	if(!fresh &&
+		std::memcmp(header->magic, k_snapshot_magic, sizeof(header->magic))
+			== 0 &&
+		header->version == version &&
+		header->w == static_cast<std::uint32_t>(w) &&
+		header->h == static_cast<std::uint32_t>(h) &&
+		header->cell_size == cell_size) {
+
+		restored_ = true;
+	} else {
+		std::memset(cells_, 0, w * h * cell_size);
+		std::memset(header, 0, sizeof(Header));
+		std::memcpy(header->magic, k_snapshot_magic, sizeof(header->magic));
+		header->version = version;
+		header->w = w;
+		header->h = h;
+		header->cell_size = cell_size;
+	}
+	return true;
+}
+
+Snapshot::~Snapshot() {
+	if(map_ != MAP_FAILED) {
+		sync();
+		munmap(map_, map_size_);
+		close(fd_);
+	}
+}
+
+void Snapshot::sync() {
+	if(map_ == MAP_FAILED) { return; }
+	Stats::Scope timing(Stats::Phase::SNAPSHOT);
+	Trace::Span span("snapshot sync");
+	// Into the page cache, so we don't sit waiting on the SD card; the kernel
+	// writes back soon, and a crash in the meantime only loses that little
+	// bit. Pages of the mapping we haven't touched still read from the file,
+	// and get the same bytes written back, so that's no trouble.
+	const unsigned char* from = static_cast<const unsigned char*>(map_);
+	std::size_t written = 0;
+	while(written < map_size_) {
+		ssize_t n = pwrite(fd_, from + written, map_size_ - written, written);
+		if(n < 0 && errno == EINTR) { continue; }
+		if(n <= 0) {
+			std::cerr << "Can't write snapshot: " << strerror(errno)
+				<< std::endl;
+			return;
+		}
+		written += n;
+	}
+}
+
+void Snapshot::disable_files() {
+	files_enabled = false;
+}
@@ -0,0 +1,51 @@
+#ifndef SNAPSHOT_HPP_
+#define SNAPSHOT_HPP_
+
+/* A grid of simulation state that's kept in a file, so that it survives
+ * restarts (and crashes) and costs a page-in to get back rather than hours of
+ * accumulation. The file is mapped privately, so the cells changing every
+ * tick don't dirty its pages (which the kernel would write back every 30s or
+ * so, wearing an SD card); it's only written when sync()ed. If the file can't
+ * be used for whatever reason it quietly falls back to ordinary memory, and
+ * the hack just starts empty.
+ */
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Snapshot {
+	int fd_;
+	void* map_;
+	std::size_t map_size_;
+	std::vector<unsigned char> fallback_;
+	unsigned char* cells_;
+	bool restored_;
+
+	bool map_file(const char* path, std::uint32_t version, int w, int h,
+		std::size_t cell_size);
+
+public:
+	// Name becomes part of the file name. Version should be bumped when the
+	// meaning of the cells changes; a mismatch (or different geometry) just
+	// starts afresh.
+	Snapshot(const char* name, std::uint32_t version, int w, int h,
+		std::size_t cell_size);
+	~Snapshot();
+	Snapshot(const Snapshot&) = delete;
+	Snapshot& operator=(const Snapshot&) = delete;
+
+	// w*h cells, zeroed if not restored.
+	template<typename T> T* cells() { return reinterpret_cast<T*>(cells_); }
+	// True if the cells came back from a previous run.
+	bool restored() const { return restored_; }
+	// Write the cells to the file (well, the page cache); doesn't wait for
+	// the disk. How often is up to the caller; also done on destruction.
+	void sync();
+
+	// Make snapshots from now on memory-only, so a benchmark neither starts
+	// from nor clobbers the real accumulation.
+	static void disable_files();
+};
+
+#endif
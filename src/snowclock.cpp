@@ -7,20 +7,38 @@
 #include <cmath>
 #include <ctime>
 
+#include <algorithm>
 #include <array>
-#include <functional>
 #include <random>
 #include <stdexcept>
 #include <vector>
 
 #include "hack.hpp"
 #include "digitalclock.hpp"
-
-constexpr int k_snowflake_count = 1024 * 2;
+#include "margolus.hpp"
+#include "snapshot.hpp"
+#include "snowflakes.hpp"
+#include "snowflow.hpp"
+#include "trace.hpp"
+#include "wallclock.hpp"
+
+constexpr Uint32 k_snapshot_version = 1;
+const Hack::Param k_param_snowflake_count =
+	{"snowflake_count", Hack::Param::Type::INT, 1024 * 2, 0, 1 << 18};
+const Hack::Param k_param_tick_duration = // ms
+	{"tick_duration", Hack::Param::Type::INT, 100, 1, 10000}; // 10Hz
+const Hack::Param k_param_fat_flakes =
+	{"fat_flakes", Hack::Param::Type::BOOL,
 #if SDLVERSION != 1
 	// Assume higher res, more powerful computer. Hacks!
-	#define FAT_FLAKES
+	true,
+#else
+	false,
 #endif
+	0, 1};
+// Draw flakes between ticks; see Hack::Base::interpolates().
+const Hack::Param k_param_interpolate =
+	{"interpolate", Hack::Param::Type::BOOL, false, 0, 1};
 
 namespace Hack {
 struct SnowClock : public Hack::Base {
@@ -41,41 +59,17 @@ struct SnowClock : public Hack::Base {
 	std::vector<int> breeze_sign;
 	unsigned int tick;
 	unsigned int next_breeze_in;
+	Uint32 tick_duration_;
+	bool fat_flakes;
+	bool interpolate;
+	bool fast_forwarding; // So nothing is kept just for drawing.
 
-	struct Snowflake {
-		Sint16 x, y, dx; // dx is sign only
-		// Inverse of dx/dy, i.e. how many ticks between each step.
-		// delay_t is the terminal velocity, the smallest delays can get.
-		unsigned int delay_x, delay_y, delay_t;
-		unsigned int mass;
-
-		void init(SnowClock& h) {
-			reset_common(h);
-			y = h.random_y(h.generator);
-			delay_y = h.random_delay_y(h.generator);
-		}
-
-		void reset_at_top(SnowClock& h) {
-			reset_common(h);
-			y = 0;
-			// Stop things getting too lockstep.
-			delay_y /= 2;
-			delay_y += 1 + (h.random_delay_y(h.generator) / 2);
-		}
-
-	private:
-		void reset_common(SnowClock& h) {
-			x = h.random_x(h.generator);
-			dx = h.random_coinflip(h.generator) == 1 ? 1 : -1;
-			delay_x = h.random_delay_x(h.generator);
-			mass = h.random_mass(h.generator);
-			delay_t = ((255-mass) / 25) + 1;
-		}
-	};
-	std::array<Snowflake, k_snowflake_count> snowflakes;
+	Snowflakes<SnowClock> snowflakes;
 
 	class StaticSnow {
-		std::vector<Uint8> snow_;
+		// Kept in a snapshot file so a restart doesn't lose the accumulation.
+		Snapshot snapshot_;
+		Uint8* snow_;
 		int w_, h_;
 		/* Dummy value for silenly allowing accesses outside the bounds, instead
 		 * of needing lots of perfect defensive coding when looking at adjacent
@@ -83,8 +77,10 @@ struct SnowClock : public Hack::Base {
 		 * threadsafe, but we're not threaded. */
 		Uint8 out_of_bounds_;
 	public:
-		StaticSnow(int w, int h) : w_(w), h_(h) {
-			snow_.resize(w_ * h_);
+		StaticSnow(int w, int h) :
+			snapshot_("snowclock", k_snapshot_version, w, h, sizeof(Uint8)),
+			snow_(snapshot_.cells<Uint8>()), w_(w), h_(h), engine_(w, h),
+			kernel_(SnowFlow::best()) {
 			//for(int y=50; y<h_-50; ++y) { at(50,y)=255; } // DEBUG
 			//for(int x=0; x<w; ++x) { for(int y=10; y<h; ++y) { at(x,y)=255; }} // DEBUG
 		}
@@ -96,75 +92,46 @@ struct SnowClock : public Hack::Base {
 			} else {
 				// Since we've done our own bounds check, and we size this
 				// precisely once in the c'tor and *shouldn't* screw that up,
-				// use unsafe operator[] instead of at() to skip doing it again.
+				// we can index the raw cells directly.
 				return snow_[x + (y*w_)];
 			}
 		}
 
-		// Flow as much snow as possible from 'from' to 'to' without overflow.
-		static void flow(Uint8& from, Uint8& to) {
-			int total = from + to;
-			to = std::min(255, total);
-			from = total - to;
-		}
-
-		void simulate(bool drop_bottom,
-			std::function<bool(int,int)> obstacles) {
-			// The bottom row of snow usually completely static once formed, but
-			// when drop_bottom is true, we let it fall away.
-			int start_y = h_ - (drop_bottom ? 1 : 2);
-			// We continue once *something* has happened to the snow here, so it
-			// only gets one change per tick.
-			for(int y = start_y; y >= 0; --y) { // bottom-up makes falling natural
-				for(int x = 0; x < w_; ++x) {
-					Uint8& here = at(x, y);
-					if(here > 0) {
-						// Hit check; get crushed by obstacles
-						if(obstacles(x, y)) { here = 0; }
-
-						// Fall check
-						// (An alternative would be to respawn them as flakes)
-						Uint8& down = at(x, y+1);
-						if((down < here) && !obstacles(x, y+1)) {
-							flow(here, down);
-							continue;
-						}
-
-						// Angle of repose check, must be away from walls
-						// FIXME The left->right sweep means we spill left-biased anyway
-						if(x > 0 && x < w_-1) {
-							Uint8& down_left = at(x-1, y+1);
-							bool down_left_obstacle = obstacles(x-1, y+1);
-							Uint8& down_right = at(x+1, y+1);
-							bool down_right_obstacle = obstacles(x+1, y+1);
-							if(down_left < here && ! down_left_obstacle) {
-								if(down_right < here && !down_right_obstacle) {
-									// Split, 3-way flow
-									int total = down_left + down_right + here;
-									down_left = std::min(255, total/2);
-									down_right = std::min(255, total/2);
-									here = total - (down_left + down_right);
-								} else {
-									// Spill left
-									flow(here, down_left);
-								}
-								continue;
-							} else if (down_right < here &&
-								!down_right_obstacle) {
-								// Spill right
-								flow(here, down_right);
-								continue;
-							}
-						}
-					}
+		void sync() { snapshot_.sync(); }
+
+		// Returns how many cells flowed.
+		int simulate(bool drop_bottom, DigitalClock& obstacles) {
+			Trace::Span span("static snow");
+			int moved = 0;
+			engine_.pass(snow_, 0,
+				[&](Uint8* top, Uint8* bottom, int y, int offset) {
+				if(bottom == nullptr) {
+					// The bottom row of snow usually completely static once
+					// formed, but when drop_bottom is true, we let it fall away.
+					if(drop_bottom) { std::fill(top, top + w_, 0); }
+					return;
 				}
-			}
+				const Uint8* solid_top = obstacles.solid_row(y);
+				const Uint8* solid_bottom = obstacles.solid_row(y+1);
+				// Each column falls (or is crushed), then whatever's left
+				// spills diagonally within its block; the angle of repose.
+				// Blocks hanging off the sides have no diagonal, which keeps
+				// spills away from the walls.
+				moved += kernel_.fall(top, bottom, solid_top, solid_bottom, w_);
+				moved += kernel_.spill(top, bottom, solid_bottom, w_, offset);
+			});
+			return moved;
 		}
+
+	private:
+		Margolus<Uint8> engine_;
+		const SnowFlow::Kernel& kernel_;
 	};
 	StaticSnow static_snow;
+	int snow_moved; // By the last static_snow.simulate().
 	DigitalClock digital_clock;
 
-	SnowClock(int w, int h)
+	SnowClock(int w, int h, const Params& params)
 		: w(w), h(h),
 		snowfb(nullptr, SDL_FreeSurface),
 		random_x(0, w-1),
@@ -179,7 +146,13 @@ struct SnowClock : public Hack::Base {
 		breeze_sign(h),
 		tick(0),
 		next_breeze_in(0),
+		tick_duration_(params.get_int(k_param_tick_duration)),
+		fat_flakes(params.get_bool(k_param_fat_flakes)),
+		interpolate(params.get_bool(k_param_interpolate)),
+		fast_forwarding(false),
+		snowflakes(params.get_int(k_param_snowflake_count), interpolate),
 		static_snow(w, h),
+		snow_moved(0),
 		digital_clock(w, h, false) {
 
 		/* Making SDL format-convert means we don't have to at write time, and
@@ -200,16 +173,17 @@ struct SnowClock : public Hack::Base {
 			throw std::runtime_error("failed to set snow palette");
 		}
 
-		for(auto&& flake : snowflakes) {
-			flake.init(*this);
+		for(size_t i = 0; i < snowflakes.size(); ++i) {
+			snowflakes.init(*this, i);
 		}
 	}
 
 	void simulate() override {
 		// Get localtime
-		std::time_t now_epoch = std::time(nullptr);
-		std::tm* now = std::localtime(&now_epoch);
+		const std::tm* now = WallClock::shared().now();
 		digital_clock.set_time(now);
+		// Write the snow back to the snapshot once a minute.
+		if(WallClock::shared().minute_changed()) { static_snow.sync(); }
 		// Modify breezes
 		if(next_breeze_in == 0) {
 			// Put energy into system
@@ -266,73 +240,80 @@ struct SnowClock : public Hack::Base {
 		}
 
 		// Move flakes
-		for(auto&& flake : snowflakes) {
+		if(interpolate && !fast_forwarding) { snowflakes.remember(); }
+		for(size_t i = 0; i < snowflakes.size(); ++i) {
+			Sint16& x = snowflakes.x(i);
+			Sint16& y = snowflakes.y(i);
 			// Breezes
-			if(flake.y >= 0 && flake.y < h &&
-				breeze_sign[flake.y] != 0 &&
-				tick % breeze_delay[flake.y] == 0) {
-				flake.x += breeze_sign[flake.y];
-				--flake.y;
+			if(y >= 0 && y < h &&
+				breeze_sign[y] != 0 &&
+				tick % breeze_delay[y] == 0) {
+				x += breeze_sign[y];
+				--y;
 			}
 
 			// Momentum
-			if(tick % flake.delay_x == 0) {
-				flake.x += flake.dx;
-			}
-			if(tick % flake.delay_y == 0) {
-				++flake.y;
-				// Accellerate due to gravity up to terminal velocity
-				if(flake.delay_y > flake.delay_t) { --flake.delay_y; }
-			}
+			snowflakes.move(i, tick);
 
 			// Wrap horizontally
-			if(flake.x < 0) { flake.x += w; }
-			if(flake.x >= w) { flake.x -= w; }
+			if(x < 0) { x += w; }
+			if(x >= w) { x -= w; }
 
 			// Collide and collect with static snow/bottom of screen
-			if(flake.y >= h) {
-				int mass = static_snow.at(flake.x, h-1) + flake.mass;
+			if(y >= h) {
+				int mass = static_snow.at(x, h-1) + snowflakes.mass(i);
 				if(mass > 255) {
-					static_snow.at(flake.x, h-2) = mass - 255;
+					static_snow.at(x, h-2) = mass - 255;
 					mass = 255;
 				}
-				static_snow.at(flake.x, h-1) = mass;
+				static_snow.at(x, h-1) = mass;
 				// Respawn
-				flake.reset_at_top(*this);
-			} else if(static_snow.at(flake.x, flake.y) > 0) {
-				int mass = static_snow.at(flake.x, flake.y) + flake.mass;
+				snowflakes.reset_at_top(*this, i);
+			} else if(static_snow.at(x, y) > 0) {
+				int mass = static_snow.at(x, y) + snowflakes.mass(i);
 				if(mass > 255) {
-					if(flake.y > 0) {
-						static_snow.at(flake.x, flake.y-1) = mass - 255;
+					if(y > 0) {
+						static_snow.at(x, y-1) = mass - 255;
 					}
 					mass = 255;
 				}
-				static_snow.at(flake.x, flake.y) = mass;
+				static_snow.at(x, y) = mass;
 				// Respawn
-				flake.reset_at_top(*this);
-			} else if(flake.y < 0) {
+				snowflakes.reset_at_top(*this, i);
+			} else if(y < 0) {
 				// Hit by a breeze a the top, respawn immediately.
-				flake.reset_at_top(*this);
-			} else if(digital_clock.solid_at(flake.x, flake.y)) {
+				snowflakes.reset_at_top(*this, i);
+			} else if(digital_clock.solid_at(x, y)) {
 				// Collide with the digital clock and settle on top
 				// (anything on top should collide with the gathered snow).
-				Uint8& above = static_snow.at(flake.x, flake.y-1);
-				above = std::min(255u, above + flake.mass);
+				Uint8& above = static_snow.at(x, y-1);
+				above = std::min(255, above + snowflakes.mass(i));
 				// Respawn
-				flake.reset_at_top(*this);
+				snowflakes.reset_at_top(*this, i);
 			}
 		}
 		// Simulate the static snow
 		// Drop out on the hour for 15 seconds.
-		static_snow.simulate(now->tm_min == 00 && now->tm_sec < 15,
-			[&](auto x, auto y){return digital_clock.solid_at(x, y);});
-			// mmmmm this generates some lovely compiler errors
-			/* std::bind(&DigitalClock::solid_at, digital_clock,
-				std::placeholders::_1, std::placeholders::_2) */
+		snow_moved = static_snow.simulate(now->tm_min == 00 && now->tm_sec < 15,
+			digital_clock);
 		++tick;
 	}
 
-	void render(SDL_Surface* fb) override {
+	Uint32 fast_forward(Uint32 ticks,
+		const std::function<bool()>& step) override {
+		fast_forwarding = true;
+		Uint32 run = Base::fast_forward(ticks, step);
+		fast_forwarding = false;
+		// Nothing to draw between until the next tick.
+		if(interpolate) { snowflakes.remember(); }
+		return run;
+	}
+
+	void render(SDL_Surface* fb) override { render_between(fb, 1.0); }
+
+	bool interpolates() override { return interpolate; }
+
+	void render_between(SDL_Surface* fb, double alpha) override {
 		// Dirty regions only work if we can unpaint previous snowflake
 		// positions, but separate simulate() makes that hard.
 		if(SDL_MUSTLOCK(snowfb.get())) { SDL_LockSurface(snowfb.get()); }
@@ -367,31 +348,49 @@ struct SnowClock : public Hack::Base {
 			}
 		}
 
-		for(auto&& flake : snowflakes) {
-			// Hope you're ready for some horrendous hackery.
-#ifdef FAT_FLAKES
-			for(Sint16 dy = -1; dy <= 1; ++dy) {
-				for(Sint16 dx = -1; dx <= 1; ++dx) {
-					if((dx != 0) && (dy != 0)) { continue; } // no corners
-					Sint16 x = flake.x + dx;
-					Sint16 y = flake.y + dy;
-					unsigned int mass = flake.mass;
-					//if((dx != 0) || (dy != 0)) { mass /= 2; } // "antialias"
-#else
-			Sint16 x = flake.x;
-			Sint16 y = flake.y;
-			unsigned int mass = flake.mass;
-#endif
+		auto plot = [&](Sint16 x, Sint16 y, unsigned int mass) {
 			// Skip out of bounds.
 			if(x < 0 || x >= w || y < 0 || y >= h)
-				{ continue; }
+				{ return; }
 			unsigned int bright = std::min(255u,
 				mass +  *pixel_at(x, y));
 			*pixel_at(x, y) = bright;
-#ifdef FAT_FLAKES
+		};
+		auto flake = [&](Sint16 x, Sint16 y, unsigned int mass) {
+			if(fat_flakes) {
+				for(Sint16 dy = -1; dy <= 1; ++dy) {
+					for(Sint16 dx = -1; dx <= 1; ++dx) {
+						if((dx != 0) && (dy != 0)) { continue; } // no corners
+						//if((dx != 0) || (dy != 0)) { mass /= 2; } // "antialias"
+						plot(x + dx, y + dy, mass);
+					}
 				}
+			} else {
+				plot(x, y, mass);
 			}
-#endif
+		};
+		for(size_t i = 0; i < snowflakes.size(); ++i) {
+			Sint16 x = snowflakes.x(i), y = snowflakes.y(i);
+			if(!interpolate || alpha >= 1.0) {
+				flake(x, y, snowflakes.mass(i));
+				continue;
+			}
+			// A flake moves a pixel or two a tick at most; further means it
+			// wrapped or respawned, so isn't coming from anywhere.
+			const Sint16 px = snowflakes.previous_x(i);
+			const Sint16 py = snowflakes.previous_y(i);
+			if(std::abs(x - px) > 2 || std::abs(y - py) > 2) {
+				flake(x, y, snowflakes.mass(i));
+				continue;
+			}
+			// Part way along: fade it out of where it was and into where it
+			// is. The shares always add up to its mass, so where the two
+			// overlap (as fat flakes a pixel apart do) stays steady, and
+			// the brightness's centre moves smoothly between them.
+			const unsigned int mass = snowflakes.mass(i);
+			const unsigned int share = std::lround(mass * alpha);
+			if(share < mass) { flake(px, py, mass - share); }
+			if(share > 0) { flake(x, y, share); }
 		}
 
 		if(SDL_MUSTLOCK(snowfb.get())) { SDL_UnlockSurface(snowfb.get()); }
@@ -400,11 +399,29 @@ struct SnowClock : public Hack::Base {
 		SDL_BlitSurface(digital_clock.rendered(), nullptr, fb, nullptr);
 	}
 
-	Uint32 tick_duration() override { return 100; } // 10Hz
+	size_t memory_footprint() override {
+		return (w * h * 3) // static snow, snowfb, clock
+			+ snowflakes.memory_footprint()
+			+ (h * (sizeof(unsigned int) + sizeof(int))); // breezes
+	}
+
+	void counters(Counters& out) override {
+		out.push_back({"flakes", static_cast<long>(snowflakes.size())});
+		out.push_back({"snow moved", snow_moved});
+	}
+
+	Uint32 tick_duration() override { return tick_duration_; }
 };
 
-std::unique_ptr<Hack::Base> MakeSnowClock(int w, int h) {
-	return std::make_unique<SnowClock>(w, h);
+std::unique_ptr<Hack::Base> MakeSnowClock(int w, int h, const Params& params) {
+	return std::make_unique<SnowClock>(w, h, params);
+}
+
+const ParamSchema& SnowClockParams() {
+	static const ParamSchema schema =
+		{k_param_snowflake_count, k_param_tick_duration, k_param_fat_flakes,
+		k_param_interpolate};
+	return schema;
 }
 
 }; // namespace Hack
@@ -0,0 +1,236 @@
+#include <algorithm>
+
+#if defined(__SSE2__)
+	#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	#include <arm_neon.h>
+	#define SNOWFLOW_NEON 1
+#endif
+
+#include "snowflow.hpp"
+
+namespace {
+	// Flow as much snow as possible from 'from' to 'to' without overflow.
+	inline void flow(Uint8& from, Uint8& to) {
+		int total = from + to;
+		to = std::min(255, total);
+		from = total - to;
+	}
+
+	inline int fall_scalar_at(Uint8* top, Uint8* bottom,
+		const Uint8* solid_top, const Uint8* solid_bottom, int x) {
+		if(top[x] == 0) { return 0; }
+		if(solid_top[x]) { top[x] = 0; return 0; }
+		if(bottom[x] < top[x] && !solid_bottom[x]) {
+			flow(top[x], bottom[x]);
+			return 1;
+		}
+		return 0;
+	}
+
+	// A column with a partner spills into it; the two top cells of a block
+	// spill into different bottom cells, so these are independent too.
+	inline int spill_scalar_at(Uint8* top, Uint8* bottom,
+		const Uint8* solid_bottom, int x, int p) {
+		if(top[x] > 0 && bottom[p] < top[x] && !solid_bottom[p]) {
+			flow(top[x], bottom[p]);
+			return 1;
+		}
+		return 0;
+	}
+
+	int fall_scalar(Uint8* top, Uint8* bottom, const Uint8* solid_top,
+		const Uint8* solid_bottom, int w) {
+		int moved = 0;
+		for(int x = 0; x < w; ++x) {
+			moved += fall_scalar_at(top, bottom, solid_top, solid_bottom, x);
+		}
+		return moved;
+	}
+
+	// Blocks are (x, x+1) for x = offset, offset+2...; a lone column at
+	// either edge has no partner.
+	int spill_scalar_from(Uint8* top, Uint8* bottom,
+		const Uint8* solid_bottom, int x, int w) {
+		int moved = 0;
+		for(; x + 1 < w; x += 2) {
+			moved += spill_scalar_at(top, bottom, solid_bottom, x, x+1);
+			moved += spill_scalar_at(top, bottom, solid_bottom, x+1, x);
+		}
+		return moved;
+	}
+
+	int spill_scalar(Uint8* top, Uint8* bottom, const Uint8* solid_bottom,
+		int w, int offset) {
+		return spill_scalar_from(top, bottom, solid_bottom, offset, w);
+	}
+
+	const SnowFlow::Kernel k_scalar = {"scalar", fall_scalar, spill_scalar};
+
+#if defined(__SSE2__)
+	/* Unsigned bytes all round. Flowing is a saturating add into the
+	 * destination, and whatever didn't fit is what stays behind, i.e.
+	 * from - (new_to - to), which is exact in wrapping byte arithmetic. */
+	inline __m128i select(__m128i mask, __m128i a, __m128i b) {
+		return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+	}
+
+	// Mask of lanes where a > b, unsigned.
+	inline __m128i greater(__m128i a, __m128i b) {
+		const __m128i zero = _mm_setzero_si128();
+		return _mm_xor_si128(_mm_cmpeq_epi8(_mm_subs_epu8(a, b), zero),
+			_mm_set1_epi8(-1));
+	}
+
+	// Flow from into to in lanes where it's lower and not solid.
+	// Returns how many lanes flowed.
+	inline int flow_sse2(__m128i& from, __m128i& to, __m128i solid) {
+		const __m128i zero = _mm_setzero_si128();
+		__m128i can = _mm_and_si128(greater(from, to),
+			_mm_cmpeq_epi8(solid, zero));
+		__m128i new_to = _mm_adds_epu8(to, from);
+		__m128i new_from = _mm_sub_epi8(from, _mm_sub_epi8(new_to, to));
+		to = select(can, new_to, to);
+		from = select(can, new_from, from);
+		return __builtin_popcount(_mm_movemask_epi8(can));
+	}
+
+	// Swap each pair of bytes, lining up a column with its block partner.
+	inline __m128i swap_pairs(__m128i v) {
+		return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+	}
+
+	inline __m128i load(const Uint8* p) {
+		return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+	}
+	inline void store(Uint8* p, __m128i v) {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p), v);
+	}
+
+	int fall_sse2(Uint8* top, Uint8* bottom, const Uint8* solid_top,
+		const Uint8* solid_bottom, int w) {
+		const __m128i zero = _mm_setzero_si128();
+		int moved = 0;
+		int x = 0;
+		for(; x + 16 <= w; x += 16) {
+			__m128i t = load(top + x);
+			// Mostly empty sky; don't bother writing it back.
+			if(_mm_movemask_epi8(_mm_cmpeq_epi8(t, zero)) == 0xffff) {
+				continue;
+			}
+			__m128i b = load(bottom + x);
+			// Crushed by obstacles.
+			t = _mm_and_si128(t, _mm_cmpeq_epi8(load(solid_top + x), zero));
+			moved += flow_sse2(t, b, load(solid_bottom + x));
+			store(top + x, t);
+			store(bottom + x, b);
+		}
+		for(; x < w; ++x) {
+			moved += fall_scalar_at(top, bottom, solid_top, solid_bottom, x);
+		}
+		return moved;
+	}
+
+	int spill_sse2(Uint8* top, Uint8* bottom, const Uint8* solid_bottom,
+		int w, int offset) {
+		const __m128i zero = _mm_setzero_si128();
+		int moved = 0;
+		// Starting on a block boundary keeps whole blocks within a vector.
+		int x = offset;
+		for(; x + 16 <= w; x += 16) {
+			__m128i t = load(top + x);
+			if(_mm_movemask_epi8(_mm_cmpeq_epi8(t, zero)) == 0xffff) {
+				continue;
+			}
+			__m128i across = swap_pairs(load(bottom + x));
+			moved += flow_sse2(t, across, swap_pairs(load(solid_bottom + x)));
+			store(top + x, t);
+			store(bottom + x, swap_pairs(across));
+		}
+		return moved + spill_scalar_from(top, bottom, solid_bottom, x, w);
+	}
+
+	const SnowFlow::Kernel k_sse2 = {"sse2", fall_sse2, spill_sse2};
+#endif
+
+#if defined(SNOWFLOW_NEON)
+	// Lanes set in a compare mask.
+	inline int count(uint8x16_t mask) {
+		uint64x2_t sums = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(
+			vshrq_n_u8(mask, 7))));
+		return vgetq_lane_u64(sums, 0) + vgetq_lane_u64(sums, 1);
+	}
+
+	// As the SSE2 version, but NEON has unsigned compares and a select.
+	inline int flow_neon(uint8x16_t& from, uint8x16_t& to, uint8x16_t solid) {
+		uint8x16_t can = vandq_u8(vcgtq_u8(from, to), vceqq_u8(solid,
+			vdupq_n_u8(0)));
+		uint8x16_t new_to = vqaddq_u8(to, from);
+		uint8x16_t new_from = vsubq_u8(from, vsubq_u8(new_to, to));
+		to = vbslq_u8(can, new_to, to);
+		from = vbslq_u8(can, new_from, from);
+		return count(can);
+	}
+
+	// Horizontal max, to skip all-empty runs; vmaxvq_u8 is AArch64 only.
+	inline bool any(uint8x16_t v) {
+		uint8x8_t m = vmax_u8(vget_low_u8(v), vget_high_u8(v));
+		return vget_lane_u64(vreinterpret_u64_u8(m), 0) != 0;
+	}
+
+	int fall_neon(Uint8* top, Uint8* bottom, const Uint8* solid_top,
+		const Uint8* solid_bottom, int w) {
+		int moved = 0;
+		int x = 0;
+		for(; x + 16 <= w; x += 16) {
+			uint8x16_t t = vld1q_u8(top + x);
+			if(!any(t)) { continue; }
+			uint8x16_t b = vld1q_u8(bottom + x);
+			t = vandq_u8(t, vceqq_u8(vld1q_u8(solid_top + x), vdupq_n_u8(0)));
+			moved += flow_neon(t, b, vld1q_u8(solid_bottom + x));
+			vst1q_u8(top + x, t);
+			vst1q_u8(bottom + x, b);
+		}
+		for(; x < w; ++x) {
+			moved += fall_scalar_at(top, bottom, solid_top, solid_bottom, x);
+		}
+		return moved;
+	}
+
+	int spill_neon(Uint8* top, Uint8* bottom, const Uint8* solid_bottom,
+		int w, int offset) {
+		int moved = 0;
+		int x = offset;
+		for(; x + 16 <= w; x += 16) {
+			uint8x16_t t = vld1q_u8(top + x);
+			if(!any(t)) { continue; }
+			uint8x16_t across = vrev16q_u8(vld1q_u8(bottom + x));
+			moved += flow_neon(t, across,
+				vrev16q_u8(vld1q_u8(solid_bottom + x)));
+			vst1q_u8(top + x, t);
+			vst1q_u8(bottom + x, vrev16q_u8(across));
+		}
+		return moved + spill_scalar_from(top, bottom, solid_bottom, x, w);
+	}
+
+	const SnowFlow::Kernel k_neon = {"neon", fall_neon, spill_neon};
+#endif
+};
+
+const SnowFlow::Kernel& SnowFlow::scalar() { return k_scalar; }
+
+const SnowFlow::Kernel& SnowFlow::best() {
+#if defined(__SSE2__)
+	if(SDL_HasSSE2()) { return k_sse2; }
+#endif
+#if defined(SNOWFLOW_NEON)
+	// SDL 1.2 can't tell us, but the compiler was told to assume it.
+	#if SDLVERSION == 1
+		return k_neon;
+	#else
+		if(SDL_HasNEON()) { return k_neon; }
+	#endif
+#endif
+	return k_scalar;
+}
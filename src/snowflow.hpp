@@ -0,0 +1,35 @@
+#ifndef SNOWFLOW_HPP_
+#define SNOWFLOW_HPP_
+
+/* Row kernels for the settled snow in SnowClock, one row pair of its Margolus
+ * pass at a time. Snow is byte-sized mass, which fits 16 to a 128-bit vector,
+ * so there are SSE2 and NEON versions alongside the plain loops. Which one is
+ * used is decided once, at runtime, from what the CPU says it has.
+ *
+ * All of them give the same result, byte for byte (and count).
+ */
+
+#include "hack.hpp"
+
+namespace SnowFlow {
+	struct Kernel {
+		const char* name;
+		// Both return how many cells flowed, for the curious.
+		// Each column on its own: top cells in solid get crushed, else flow
+		// down as far as the cell below has room, if it has less than us.
+		int (*fall)(Uint8* top, Uint8* bottom, const Uint8* solid_top,
+			const Uint8* solid_bottom, int w);
+		// Whatever's left in a top cell flows into the bottom cell of the
+		// other column of its block, if that has less and isn't solid.
+		// offset is the block grid offset for the pass.
+		int (*spill)(Uint8* top, Uint8* bottom, const Uint8* solid_bottom,
+			int w, int offset);
+	};
+
+	// The plain loops, always available.
+	const Kernel& scalar();
+	// The fastest this CPU supports.
+	const Kernel& best();
+};
+
+#endif
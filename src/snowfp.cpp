@@ -14,7 +14,10 @@
 
 #include "hack.hpp"
 
-constexpr int k_snowflake_count = 1024;
+const Hack::Param k_param_snowflake_count =
+	{"snowflake_count", Hack::Param::Type::INT, 1024, 0, 1 << 18};
+const Hack::Param k_param_tick_duration = // ms
+	{"tick_duration", Hack::Param::Type::INT, 100, 1, 10000}; // 10Hz
 
 namespace Hack {
 struct DriftingSnow : public Hack::Base {
@@ -24,6 +27,7 @@ struct DriftingSnow : public Hack::Base {
 	std::uniform_int_distribution<int> random_y;
 	std::uniform_real_distribution<double> random_frac;
 	std::array<Uint32, 256> greyscale;
+	Uint32 tick_duration_;
 
 	struct Snowflake {
 		double x, y, z, dx, dy;
@@ -60,15 +64,17 @@ struct DriftingSnow : public Hack::Base {
 			full_size = half_size * 2.0;*/
 		}
 	};
-	std::array<Snowflake, k_snowflake_count> snowflakes;
+	std::vector<Snowflake> snowflakes;
 
 	std::vector<double> breezes;
 
-	DriftingSnow(int w, int h, SDL_PixelFormat* fmt)
+	DriftingSnow(int w, int h, SDL_PixelFormat* fmt, const Params& params)
 		: w(w), h(h),
 		random_x(0, w-1),
 		random_y(0, h-1),
 		random_frac(0.0, 1.0),
+		tick_duration_(params.get_int(k_param_tick_duration)),
+		snowflakes(params.get_int(k_param_snowflake_count)),
 		breezes(h) {
 
 		for(int i=0; i<256; ++i) {
@@ -160,11 +166,22 @@ struct DriftingSnow : public Hack::Base {
 		if(SDL_MUSTLOCK(fb)) { SDL_UnlockSurface(fb); }
 	}
 
-	Uint32 tick_duration() override { return 100; } // 10Hz
+	void counters(Counters& out) override {
+		out.push_back({"flakes", static_cast<long>(snowflakes.size())});
+	}
+
+	Uint32 tick_duration() override { return tick_duration_; }
 };
 
-std::unique_ptr<Hack::Base> MakeSnowFP(int w, int h, SDL_PixelFormat* fmt) {
-	return std::make_unique<DriftingSnow>(w, h, fmt);
+std::unique_ptr<Hack::Base> MakeSnowFP(int w, int h, SDL_PixelFormat* fmt,
+	const Params& params) {
+	return std::make_unique<DriftingSnow>(w, h, fmt, params);
+}
+
+const ParamSchema& SnowFPParams() {
+	static const ParamSchema schema =
+		{k_param_snowflake_count, k_param_tick_duration};
+	return schema;
 }
 
 }; // namespace Hack
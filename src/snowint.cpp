@@ -12,8 +12,12 @@
 #include <vector>
 
 #include "hack.hpp"
+#include "snowflakes.hpp"
 
-constexpr int k_snowflake_count = 4096;
+const Hack::Param k_param_snowflake_count =
+	{"snowflake_count", Hack::Param::Type::INT, 4096, 0, 1 << 18};
+const Hack::Param k_param_tick_duration = // ms
+	{"tick_duration", Hack::Param::Type::INT, 100, 1, 10000}; // 10Hz
 
 namespace Hack {
 struct SnowInt : public Hack::Base {
@@ -32,40 +36,11 @@ struct SnowInt : public Hack::Base {
 	std::vector<int> breeze_sign;
 	unsigned int tick;
 	unsigned int next_breeze_in;
+	Uint32 tick_duration_;
 
-	struct Snowflake {
-		Sint16 x, y, dx; // dx is sign only
-		// Inverse of dx/dy, i.e. how many ticks between each step.
-		// delay_t is the terminal velocity, the smallest delays can get.
-		unsigned int delay_x, delay_y, delay_t;
-		unsigned int mass;
-
-		void init(SnowInt& h) {
-			reset_common(h);
-			y = h.random_y(h.generator);
-			delay_y = h.random_delay_y(h.generator);
-		}
-
-		void reset_at_top(SnowInt& h) {
-			reset_common(h);
-			y = 0;
-			// Stop things getting too lockstep.
-			delay_y /= 2;
-			delay_y += 1 + (h.random_delay_y(h.generator) / 2);
-		}
+	Snowflakes<SnowInt> snowflakes;
 
-	private:
-		void reset_common(SnowInt& h) {
-			x = h.random_x(h.generator);
-			dx = h.random_coinflip(h.generator) == 1 ? 1 : -1;
-			delay_x = h.random_delay_x(h.generator);
-			mass = h.random_mass(h.generator);
-			delay_t = ((255-mass) / 25) + 1;
-		}
-	};
-	std::array<Snowflake, k_snowflake_count> snowflakes;
-
-	SnowInt(int w, int h, SDL_PixelFormat* fmt)
+	SnowInt(int w, int h, SDL_PixelFormat* fmt, const Params& params)
 		: w(w), h(h),
 		random_x(0, w-1),
 		random_y(0, h-1),
@@ -78,13 +53,15 @@ struct SnowInt : public Hack::Base {
 		breeze_delay(h),
 		breeze_sign(h),
 		tick(0),
-		next_breeze_in(0) {
+		next_breeze_in(0),
+		tick_duration_(params.get_int(k_param_tick_duration)),
+		snowflakes(params.get_int(k_param_snowflake_count)) {
 
 		for(int i=0; i<256; ++i) {
 			greyscale[i] = SDL_MapRGB(fmt, i, i, i);
 		}
-		for(auto&& flake : snowflakes) {
-			flake.init(*this);
+		for(size_t i = 0; i < snowflakes.size(); ++i) {
+			snowflakes.init(*this, i);
 		}
 	}
 
@@ -147,29 +124,24 @@ struct SnowInt : public Hack::Base {
 		}
 
 		// Move flakes
-		for(auto&& flake : snowflakes) {
+		for(size_t i = 0; i < snowflakes.size(); ++i) {
+			Sint16& x = snowflakes.x(i);
+			Sint16& y = snowflakes.y(i);
 			// Breezes
-			if(flake.y >= 0 && flake.y < h &&
-				breeze_sign[flake.y] != 0 &&
-				tick % breeze_delay[flake.y] == 0) {
-				flake.x += breeze_sign[flake.y];
-				--flake.y;
+			if(y >= 0 && y < h &&
+				breeze_sign[y] != 0 &&
+				tick % breeze_delay[y] == 0) {
+				x += breeze_sign[y];
+				--y;
 			}
 
 			// Momentum
-			if(tick % flake.delay_x == 0) {
-				flake.x += flake.dx;
-			}
-			if(tick % flake.delay_y == 0) {
-				++flake.y;
-				// Accellerate due to gravity up to terminal velocity
-				if(flake.delay_y > flake.delay_t) { --flake.delay_y; }
-			}
+			snowflakes.move(i, tick);
 
 			// Wrap
-			if(flake.x < 0) { flake.x += w; }
-			if(flake.x >= w) { flake.x -= w; }
-			if(flake.y > h) { flake.reset_at_top(*this); }
+			if(x < 0) { x += w; }
+			if(x >= w) { x -= w; }
+			if(y > h) { snowflakes.reset_at_top(*this, i); }
 		}
 		++tick;
 	}
@@ -197,24 +169,35 @@ struct SnowInt : public Hack::Base {
 		}
 #endif
 
-		for(auto&& flake : snowflakes) {
-			SDL_Rect position { flake.x, flake.y, 1, 1};
+		for(size_t i = 0; i < snowflakes.size(); ++i) {
+			SDL_Rect position { snowflakes.x(i), snowflakes.y(i), 1, 1};
 			// Skip out of bounds.
 			if(position.x < 0 || position.x >= w
 				|| position.y < 0 || position.y >= h)
 				{ continue; }
-			unsigned int bright = flake.mass;
+			unsigned int bright = snowflakes.mass(i);
 			SDL_FillRect(fb, &position, greyscale[bright]);
 		}
 
 		if(SDL_MUSTLOCK(fb)) { SDL_UnlockSurface(fb); }
 	}
 
-	Uint32 tick_duration() override { return 100; } // 10Hz
+	void counters(Counters& out) override {
+		out.push_back({"flakes", static_cast<long>(snowflakes.size())});
+	}
+
+	Uint32 tick_duration() override { return tick_duration_; }
 };
 
-std::unique_ptr<Hack::Base> MakeSnowInt(int w, int h, SDL_PixelFormat* fmt) {
-	return std::make_unique<SnowInt>(w, h, fmt);
+std::unique_ptr<Hack::Base> MakeSnowInt(int w, int h, SDL_PixelFormat* fmt,
+	const Params& params) {
+	return std::make_unique<SnowInt>(w, h, fmt, params);
+}
+
+const ParamSchema& SnowIntParams() {
+	static const ParamSchema schema =
+		{k_param_snowflake_count, k_param_tick_duration};
+	return schema;
 }
 
 }; // namespace Hack
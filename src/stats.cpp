@@ -0,0 +1,64 @@
+#include <cstdlib>
+#include <iomanip>
+
+#include "stats.hpp"
+
+namespace Stats {
+
+constexpr int k_phase_count = static_cast<int>(Phase::COUNT);
+
+static Totals totals_[k_phase_count];
+static bool enabled_ = std::getenv("PIXMAS_STATS") != nullptr;
+
+bool enabled() {
+	return enabled_;
+}
+
+void enable() {
+	enabled_ = true;
+}
+
+void record(Phase phase, std::uint64_t us) {
+	Totals& t = totals_[static_cast<int>(phase)];
+	++t.count;
+	t.total_us += us;
+	if(us > t.worst_us) { t.worst_us = us; }
+	t.last_us = us;
+}
+
+const Totals& totals(Phase phase) {
+	return totals_[static_cast<int>(phase)];
+}
+
+const char* name(Phase phase) {
+	switch(phase) {
+		case Phase::SIMULATE:  return "simulate";
+		case Phase::RENDER:    return "render";
+		case Phase::UPLOAD:    return "upload";
+		case Phase::PRESENT:   return "present";
+		case Phase::MENU_OPEN: return "menu open";
+		case Phase::SNAPSHOT:  return "snapshot";
+		case Phase::COUNT: break;
+	}
+	return "?";
+}
+
+void report(std::ostream& out) {
+	if(!enabled()) { return; }
+	out << std::left << std::setw(12) << "phase" << std::right
+		<< std::setw(10) << "count"
+		<< std::setw(12) << "mean ms"
+		<< std::setw(12) << "worst ms" << std::endl;
+	out << std::fixed << std::setprecision(3);
+	for(int i = 0; i < k_phase_count; ++i) {
+		const Totals& t = totals_[i];
+		if(t.count == 0) { continue; }
+		out << std::left << std::setw(12) << name(static_cast<Phase>(i))
+			<< std::right
+			<< std::setw(10) << t.count
+			<< std::setw(12) << (t.total_us / 1000.0) / t.count
+			<< std::setw(12) << t.worst_us / 1000.0 << std::endl;
+	}
+}
+
+}; // namespace Stats
@@ -0,0 +1,55 @@
+#ifndef STATS_HPP_
+#define STATS_HPP_
+
+/* Lightweight per-phase timing, for finding out where the time in a tick goes
+ * on the actual hardware. Off unless PIXMAS_STATS is set in the environment
+ * (or something asks for it), in which case a summary is printed to stderr at
+ * exit.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+namespace Stats {
+	enum class Phase {
+		SIMULATE, RENDER, UPLOAD, PRESENT, MENU_OPEN, SNAPSHOT,
+		COUNT // not a phase
+	};
+
+	struct Totals {
+		std::uint64_t count;
+		std::uint64_t total_us;
+		std::uint64_t worst_us;
+		std::uint64_t last_us;
+	};
+
+	bool enabled();
+	// Start recording even without PIXMAS_STATS (e.g. for the overlay).
+	void enable();
+	void record(Phase phase, std::uint64_t us);
+	const Totals& totals(Phase phase);
+	const char* name(Phase phase);
+	void report(std::ostream& out);
+
+	// Times its own lifetime into a phase.
+	class Scope {
+		Phase phase_;
+		bool enabled_;
+		std::chrono::steady_clock::time_point start_;
+	public:
+		explicit Scope(Phase phase) : phase_(phase), enabled_(enabled()) {
+			if(enabled_) { start_ = std::chrono::steady_clock::now(); }
+		}
+		~Scope() {
+			if(!enabled_) { return; }
+			auto elapsed = std::chrono::steady_clock::now() - start_;
+			record(phase_, std::chrono::duration_cast<
+				std::chrono::microseconds>(elapsed).count());
+		}
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+};
+
+#endif
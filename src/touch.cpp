@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "touch.hpp"
+
+// How many /dev/input/eventN to look through for a touchscreen.
+constexpr int k_max_event_devices = 32;
+// How long the reader waits for input before checking whether to quit.
+constexpr int k_poll_ms = 100;
+
+namespace {
+	constexpr size_t k_bits_per_long = 8 * sizeof(unsigned long);
+
+	bool has_bit(const unsigned long* bits, int bit) {
+		return (bits[bit / k_bits_per_long] >> (bit % k_bits_per_long)) & 1;
+	}
+
+	// Where value is along the axis, from 0 to size - 1.
+	int map_axis(int value, const input_absinfo& axis, int size) {
+		const long range = std::max(1, axis.maximum - axis.minimum);
+		const long at = (static_cast<long>(value - axis.minimum) * (size - 1))
+			/ range;
+		return std::min<long>(size - 1, std::max<long>(0, at));
+	}
+};
+
+Touch::Touch(const std::string& path, int w, int h) :
+	fd_(-1), w_(w), h_(h), x_axis_(), y_axis_(), quit_(false) {
+
+	if(!path.empty()) {
+		if(!open_device(path)) {
+			throw std::runtime_error("No touchscreen at '" + path + "'");
+		}
+	} else {
+		for(int i = 0; i < k_max_event_devices && fd_ == -1; ++i) {
+			open_device("/dev/input/event" + std::to_string(i));
+		}
+		if(fd_ == -1) {
+			throw std::runtime_error("No touchscreen in /dev/input");
+		}
+	}
+	thread_ = std::thread(&Touch::run, this);
+}
+
+Touch::~Touch() {
+	quit_ = true;
+	thread_.join(); // Within k_poll_ms.
+	close(fd_);
+}
+
+// Open path if it's a touchscreen: reports touches, and absolute X and Y.
+bool Touch::open_device(const std::string& path) {
+	int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if(fd == -1) { return false; }
+	unsigned long keys[(KEY_MAX / k_bits_per_long) + 1] = {};
+	unsigned long axes[(ABS_MAX / k_bits_per_long) + 1] = {};
+	if(ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keys)), keys) < 0 ||
+		ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(axes)), axes) < 0 ||
+		!has_bit(keys, BTN_TOUCH) ||
+		!has_bit(axes, ABS_X) || !has_bit(axes, ABS_Y) ||
+		ioctl(fd, EVIOCGABS(ABS_X), &x_axis_) < 0 ||
+		ioctl(fd, EVIOCGABS(ABS_Y), &y_axis_) < 0) {
+		close(fd);
+		return false;
+	}
+	fd_ = fd;
+	path_ = path;
+	return true;
+}
+
+void Touch::run() {
+	int x = 0, y = 0;
+	bool down = false, was_down = false, moved = false;
+	pollfd wait = {fd_, POLLIN, 0};
+	while(!quit_) {
+		if(poll(&wait, 1, k_poll_ms) <= 0) { continue; }
+		input_event events[16];
+		ssize_t n = read(fd_, events, sizeof(events));
+		if(n < 0 && (errno == EAGAIN || errno == EINTR)) { continue; }
+		if(n <= 0) {
+			// Unplugged, say. Nothing more is coming.
+			std::cerr << "Can't read touchscreen '" << path_ << "': "
+				<< (n < 0 ? std::strerror(errno) : "end of file")
+				<< std::endl;
+			return;
+		}
+		for(size_t i = 0; i < n / sizeof(input_event); ++i) {
+			const input_event& event = events[i];
+			if(event.type == EV_ABS && event.code == ABS_X) {
+				x = map_axis(event.value, x_axis_, w_);
+				moved = true;
+			} else if(event.type == EV_ABS && event.code == ABS_Y) {
+				y = map_axis(event.value, y_axis_, h_);
+				moved = true;
+			} else if(event.type == EV_KEY && event.code == BTN_TOUCH) {
+				down = event.value != 0;
+			} else if(event.type == EV_SYN && event.code == SYN_REPORT) {
+				// A complete report; the position and touch go together.
+				if(down && !was_down) {
+					push(SDL_MOUSEBUTTONDOWN, x, y);
+				} else if(!down && was_down) {
+					push(SDL_MOUSEBUTTONUP, x, y);
+				} else if(down && moved) {
+					push(SDL_MOUSEMOTION, x, y);
+				}
+				was_down = down;
+				moved = false;
+			}
+		}
+	}
+}
+
+void Touch::push(Uint32 type, int x, int y) {
+	SDL_Event event = {};
+	event.type = type;
+	if(type == SDL_MOUSEMOTION) {
+		event.motion.timestamp = SDL_GetTicks();
+		event.motion.state = SDL_BUTTON_LMASK;
+		event.motion.x = x;
+		event.motion.y = y;
+	} else {
+		event.button.timestamp = SDL_GetTicks();
+		event.button.button = SDL_BUTTON_LEFT;
+		event.button.state = type == SDL_MOUSEBUTTONDOWN ?
+			SDL_PRESSED : SDL_RELEASED;
+		event.button.clicks = 1;
+		event.button.x = x;
+		event.button.y = y;
+	}
+	// Safe from any thread.
+	SDL_PushEvent(&event);
+}
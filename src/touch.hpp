@@ -0,0 +1,46 @@
+#ifndef TOUCH_HPP_
+#define TOUCH_HPP_
+
+/* Touchscreen input straight from the kernel's evdev device, for when SDL
+ * isn't getting any: the fbdev backend runs SDL with its dummy video driver,
+ * which has no input of its own. Touches are read on a thread of their own
+ * and pushed into SDL's event queue as the mouse events a window would get
+ * (button down, motion while down, button up), in the hacks' co-ordinates, so
+ * the menu works the same either way.
+ *
+ * The touch axes are mapped straight onto the display's; a panel mounted
+ * rotated against its touch layer would need them swapping here.
+ */
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include <linux/input.h>
+
+#include "hack.hpp"
+
+class Touch {
+	int fd_;
+	std::string path_;
+	int w_, h_; // To map positions onto.
+	input_absinfo x_axis_, y_axis_;
+	std::atomic<bool> quit_;
+	std::thread thread_;
+
+	bool open_device(const std::string& path);
+	void run();
+	void push(Uint32 type, int x, int y);
+
+public:
+	// An empty path takes the first /dev/input/event* that reports touches.
+	// Throws std::runtime_error if there's no such device to read.
+	Touch(const std::string& path, int w, int h);
+	~Touch();
+	Touch(const Touch&) = delete;
+	Touch& operator=(const Touch&) = delete;
+
+	const std::string& path() const { return path_; }
+};
+
+#endif
@@ -0,0 +1,117 @@
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+#include "trace.hpp"
+
+namespace Trace {
+
+// Power of two, so the index wraps with a mask. ~2MB.
+constexpr std::uint64_t k_ring_size = 64 * 1024;
+
+namespace {
+	/* seq is the ring index written plus one, set last (and cleared first),
+	 * so a dump racing a writer can tell a slot is mid-write and skip it.
+	 * The rest are atomic too, if only relaxed (so plain loads and stores on
+	 * anything we run on), so that reading them mid-write gets a torn event
+	 * to throw away rather than a data race. */
+	struct Event {
+		std::atomic<std::uint64_t> seq;
+		std::atomic<const char*> name;
+		std::atomic<std::uint64_t> begin_us;
+		std::atomic<std::uint64_t> end_us;
+		std::atomic<std::uint32_t> tid;
+	};
+
+	const char* path() {
+		static const char* path = std::getenv("PIXMAS_TRACE");
+		return path;
+	}
+
+	std::unique_ptr<Event[]> ring;
+	std::atomic<std::uint64_t> next(0);
+	std::atomic<std::uint32_t> next_tid(0);
+	volatile std::sig_atomic_t dump_requested = 0;
+	const auto epoch = std::chrono::steady_clock::now();
+
+	std::uint32_t thread_id() {
+		thread_local std::uint32_t tid = next_tid++;
+		return tid;
+	}
+
+	void on_signal(int) { dump_requested = 1; }
+};
+
+bool enabled() {
+	static const bool enabled = path() != nullptr && path()[0] != '\0';
+	return enabled;
+}
+
+void install() {
+	if(!enabled()) { return; }
+	ring.reset(new Event[k_ring_size]());
+	std::signal(SIGUSR1, on_signal);
+}
+
+void poll() {
+	if(dump_requested) {
+		dump_requested = 0;
+		dump();
+	}
+}
+
+std::uint64_t now_us() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - epoch).count();
+}
+
+void record(const char* name, std::uint64_t begin_us, std::uint64_t end_us) {
+	if(!ring) { return; } // Enabled but not installed yet.
+	std::uint64_t index = next.fetch_add(1, std::memory_order_relaxed);
+	Event& event = ring[index & (k_ring_size - 1)];
+	event.seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	event.name.store(name, std::memory_order_relaxed);
+	event.begin_us.store(begin_us, std::memory_order_relaxed);
+	event.end_us.store(end_us, std::memory_order_relaxed);
+	event.tid.store(thread_id(), std::memory_order_relaxed);
+	event.seq.store(index + 1, std::memory_order_release);
+}
+
+void dump() {
+	if(!ring) { return; }
+	std::FILE* out = std::fopen(path(), "w");
+	if(out == nullptr) {
+		std::cerr << "Can't write trace to '" << path() << "'" << std::endl;
+		return;
+	}
+	const std::uint64_t end = next.load(std::memory_order_acquire);
+	const std::uint64_t begin = end > k_ring_size ? end - k_ring_size : 0;
+	std::fputs("{\"traceEvents\":[\n", out);
+	bool first = true;
+	for(std::uint64_t index = begin; index < end; ++index) {
+		Event& event = ring[index & (k_ring_size - 1)];
+		if(event.seq.load(std::memory_order_acquire) != index + 1) { continue; }
+		const char* name = event.name.load(std::memory_order_relaxed);
+		std::uint64_t begin_us = event.begin_us.load(std::memory_order_relaxed);
+		std::uint64_t end_us = event.end_us.load(std::memory_order_relaxed);
+		std::uint32_t tid = event.tid.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		// Overwritten while we read it.
+		if(event.seq.load(std::memory_order_relaxed) != index + 1) { continue; }
+		std::fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+			"\"tid\":%u,\"ts\":%llu,\"dur\":%llu}",
+			first ? "" : ",\n", name, static_cast<unsigned>(tid),
+			static_cast<unsigned long long>(begin_us),
+			static_cast<unsigned long long>(end_us - begin_us));
+		first = false;
+	}
+	std::fputs("\n]}\n", out);
+	std::fclose(out);
+	std::cerr << "Trace written to '" << path() << "'" << std::endl;
+}
+
+}; // namespace Trace
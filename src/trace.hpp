@@ -0,0 +1,47 @@
+#ifndef TRACE_HPP_
+#define TRACE_HPP_
+
+/* Span tracing, for seeing where an individual slow frame went rather than the
+ * averages Stats gives. Off unless PIXMAS_TRACE is set in the environment to
+ * a file name; then spans go into a fixed-size in-memory ring (the most recent
+ * ones win), which is written out as Chrome trace-event JSON, for Perfetto or
+ * chrome://tracing, on SIGUSR1 and at exit.
+ *
+ * Recording is lock-free, so spans can come from any thread.
+ */
+
+#include <chrono>
+#include <cstdint>
+
+namespace Trace {
+	bool enabled();
+	// Catch SIGUSR1 to dump. Does nothing if not enabled.
+	void install();
+	// Call regularly from the main loop and the menu; dumps if SIGUSR1 has
+	// arrived.
+	void poll();
+	// Write out the ring now.
+	void dump();
+
+	std::uint64_t now_us();
+	// name must outlive the trace, i.e. be a literal.
+	void record(const char* name, std::uint64_t begin_us, std::uint64_t end_us);
+
+	// Records its own lifetime as a span.
+	class Span {
+		const char* name_;
+		bool enabled_;
+		std::uint64_t begin_us_;
+	public:
+		explicit Span(const char* name) : name_(name), enabled_(enabled()) {
+			if(enabled_) { begin_us_ = now_us(); }
+		}
+		~Span() {
+			if(enabled_) { record(name_, begin_us_, now_us()); }
+		}
+		Span(const Span&) = delete;
+		Span& operator=(const Span&) = delete;
+	};
+};
+
+#endif
@@ -0,0 +1,39 @@
+#include <chrono>
+
+#include "wallclock.hpp"
+
+WallClock::WallClock() :
+	epoch_(-1), tm_(),
+	second_changed_(false), minute_changed_(false) {}
+
+WallClock& WallClock::shared() {
+	static WallClock clock;
+	return clock;
+}
+
+void WallClock::tick() {
+	tick(std::time(nullptr));
+}
+
+void WallClock::tick(std::time_t now_epoch) {
+	if(now_epoch == epoch_) {
+		second_changed_ = minute_changed_ = false;
+		return;
+	}
+	const bool first = epoch_ == -1;
+	const std::tm previous = tm_;
+	epoch_ = now_epoch;
+	localtime_r(&epoch_, &tm_);
+	// Compare fields rather than assume one tick per second, since we can be
+	// stalled (or the clock stepped) across several.
+	second_changed_ = true;
+	minute_changed_ = first || (tm_.tm_min != previous.tm_min)
+		|| (tm_.tm_hour != previous.tm_hour);
+}
+
+Uint32 WallClock::until_next_second() const {
+	auto since_epoch = std::chrono::system_clock::now().time_since_epoch();
+	auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+		since_epoch).count() % 1000;
+	return 1000 - ms;
+}
@@ -0,0 +1,39 @@
+#ifndef WALLCLOCK_HPP_
+#define WALLCLOCK_HPP_
+
+#include <ctime>
+
+#include "hack.hpp"
+
+/* Shared wall-clock time for the hacks.
+ * The main loop ticks this once before each simulate(), so everything sees the
+ * same timestamp for a tick, and the (timezone-consulting) conversion to local
+ * time only happens when the second actually changes.
+ */
+class WallClock {
+	std::time_t epoch_;
+	std::tm tm_;
+	bool second_changed_;
+	bool minute_changed_;
+
+public:
+	WallClock();
+
+	// The instance the main loop drives.
+	static WallClock& shared();
+
+	// Sample the time. Call once per simulation tick.
+	void tick();
+	// Or take it as given, for running to a fake clock (benchmarking).
+	void tick(std::time_t now_epoch);
+	// Local time as of the last tick(); treat as const.
+	const std::tm* now() const { return &tm_; }
+	// Whether the last tick() moved into a new second, or a new minute.
+	// Both are true after the first tick().
+	bool second_changed() const { return second_changed_; }
+	bool minute_changed() const { return minute_changed_; }
+	// Milliseconds from now until the next second boundary.
+	Uint32 until_next_second() const;
+};
+
+#endif